@@ -15,5 +15,7 @@ void adminCancelReservation();
 void adminPrintTicket();
 void adminSetBusDetails();
 void adminLogout();
+void adminViewMetrics();
+void adminExportReport();
 
 #endif
@@ -7,11 +7,59 @@
 #include "booking_system.h"
 #include "payment_processing.h"
 
-int main() {
+int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "--client") == 0) {
+        return runClient(argc > 2 ? argv[2] : SERVER_SOCKET_PATH);
+    }
+    
     initializeSystem();
+    
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return runBenchmarks(argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_ROUTES,
+                             argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_BOOKINGS,
+                             argc > 4 ? atoi(argv[4]) : BENCH_DEFAULT_ITERATIONS);
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--loadgen") == 0) {
+        return runLoadGenerator(argc > 2 ? atoi(argv[2]) : LOADGEN_DEFAULT_THREADS,
+                                argc > 3 ? atoi(argv[3]) : LOADGEN_DEFAULT_SECONDS,
+                                argc > 4 ? atol(argv[4]) : 0,
+                                argc > 5 ? atoi(argv[5]) : LOADGEN_DEFAULT_ROUTES);
+    }
+    
     initializeUsers();
     loadUserData();
     loadRoutesData();
+    openJournal();
+    
+    if(argc > 1 && strcmp(argv[1], "--report") == 0) {
+        return runReport(argc, argv);
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        FILE *input = stdin;
+        if(argc > 2 && strcmp(argv[2], "-") != 0) {
+            input = fopen(argv[2], "r");
+            if(input == NULL) {
+                fprintf(stderr, "Unable to open %s\n", argv[2]);
+                return 1;
+            }
+        }
+        runBatch(input);
+        saveUserData();
+        checkpointJournal();
+        writeMetricsFile(METRICS_DUMP_PATH);
+        return 0;
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        int port = argc > 2 ? atoi(argv[2]) : SERVER_DEFAULT_PORT;
+        int status = runServer(port, argc > 3 ? argv[3] : SERVER_SOCKET_PATH);
+        saveUserData();
+        checkpointJournal();
+        writeMetricsFile(METRICS_DUMP_PATH);
+        return status;
+    }
     
     int choice;
     
@@ -42,7 +90,8 @@ int main() {
                 break;
             case 4:
                 saveUserData();
-                saveRoutesData();
+                checkpointJournal();
+                writeMetricsFile(METRICS_DUMP_PATH);
                 printf("Thank you for using our booking system. Goodbye!\n");
                 break;
             default:
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Runs each tests/*.batch through "ttbs --batch -" in a fresh directory and
+# compares the replies with the matching .expected file. A "# sleep N" line
+# pauses the input for N seconds, for holds that have to run out; any other
+# '#' line is a comment the batch runner skips. Pay in cash so replies carry
+# no clock-based transaction ids.
+#
+#   sh tests/run.sh            (CC and CFLAGS are honoured)
+
+here=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+${CC:-cc} ${CFLAGS:--O2} -pthread -o "$work/ttbs" "$here/../whole_file.c" || exit 1
+
+status=0
+for batch in "$here"/*.batch; do
+    name=$(basename "$batch" .batch)
+    mkdir "$work/$name"
+    (
+        cd "$work/$name" || exit 1
+        while IFS= read -r line; do
+            case "$line" in
+                "# sleep "*) sleep "${line#\# sleep }" ;;
+            esac
+            printf '%s\n' "$line"
+        done < "$batch" | ../ttbs --batch - > ../"$name".out 2> ../"$name".err
+    )
+    if diff -u "$here/$name.expected" "$work/$name.out"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        status=1
+    fi
+done
+exit $status
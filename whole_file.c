@@ -1,1136 +1,7716 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <time.h>
-
-#define TOTAL_SEATS 40
-#define NAME_LENGTH 50
-#define SOURCE_LENGTH 30
-#define DESTINATION_LENGTH 30
-#define TIME_LENGTH 10
-#define USERNAME_LENGTH 20
-#define PASSWORD_LENGTH 20
-#define MAX_USERS 100
-#define MAX_ROUTES 50
-#define PHONE_LENGTH 15
-#define TRANSACTION_ID_LENGTH 20
-
-typedef struct {
-    int paymentID;
-    char method[20];
-    char transactionID[TRANSACTION_ID_LENGTH];
-    float amount;
-    float feePercent;
-    float totalPaid;
-    char status[20];
-} Payment;
-
-typedef struct {
-    int routeID;
-    char source[SOURCE_LENGTH];
-    char destination[DESTINATION_LENGTH];
-    char busTime[TIME_LENGTH];
-    int seats[TOTAL_SEATS];
-    int bookedCount;
-    int isActive;
-} Route;
-
-typedef struct {
-    int seatNo;
-    char name[NAME_LENGTH];
-    char phone[PHONE_LENGTH];
-    int routeID;
-    int paymentID;
-    int isBooked;
-} Booking;
-
-typedef struct {
-    char username[USERNAME_LENGTH];
-    char password[PASSWORD_LENGTH];
-    int isActive;
-} User;
-
-Booking bookings[TOTAL_SEATS * MAX_ROUTES];
-User users[MAX_USERS];
-Route routes[MAX_ROUTES];
-Payment payments[TOTAL_SEATS * MAX_ROUTES];
-
-int bookedSeats = 0;
-int userCount = 0;
-int routeCount = 0;
-int paymentCount = 0;
-int currentUserIndex = -1;
-
-float BASE_FARE = 500.0;
-
-void initializeSystem();
-void initializeUsers();
-void userSignup();
-void userLogin();
-int authenticateAdmin();
-void adminPanel();
-void userMenu();
-void viewAvailableSeatsForRoute(char source[], char destination[]);
-void bookTicket();
-int findOrCreateRoute(char source[], char destination[]);
-void showRouteSeats(int routeIndex);
-void editReservation();
-void cancelReservation();
-void viewAllBookings();
-void printTicket(int seatNumber, int routeIndex);
-void adminViewPassengerDetails();
-void adminSearchByPhone();
-void adminSearchByDestination();
-void showDestinationHints(char partialDest[]);
-void adminCancelReservation();
-void adminPrintTicket();
-void adminSetBusDetails();
-void adminLogout();
-void processPayment(int bookingIndex, int routeIndex);
-void generateTransactionID(char transID[]);
-void calculatePayment(float *amount, float *fee, float *total, char method[]);
-void clearInputBuffer();
-void saveUserData();
-void loadUserData();
-void saveRoutesData();
-void loadRoutesData();
-
-int main() {
-    initializeSystem();
-    initializeUsers();
-    loadUserData();
-    loadRoutesData();
-    
-    int choice;
-    
-    printf("=== Welcome to Transport Ticket Booking System ===\n");
-    
-    do {
-        printf("\n=== MAIN MENU ===\n");
-        printf("1. User Login\n");
-        printf("2. User Signup\n");
-        printf("3. Admin Login\n");
-        printf("4. Exit\n");
-        printf("=================\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clearInputBuffer();
-        
-        switch(choice) {
-            case 1:
-                userLogin();
-                break;
-            case 2:
-                userSignup();
-                break;
-            case 3:
-                if(authenticateAdmin()) {
-                    adminPanel();
-                }
-                break;
-            case 4:
-                saveUserData();
-                saveRoutesData();
-                printf("Thank you for using our booking system. Goodbye!\n");
-                break;
-            default:
-                printf("Invalid choice! Please try again.\n");
-        }
-    } while(choice != 4);
-    
-    return 0;
-}
-
-void initializeSystem() {
-    srand(time(0));
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        bookings[i].seatNo = (i % TOTAL_SEATS) + 1;
-        bookings[i].isBooked = 0;
-        strcpy(bookings[i].name, "");
-        strcpy(bookings[i].phone, "");
-        bookings[i].routeID = -1;
-        bookings[i].paymentID = -1;
-    }
-    
-    for(int i = 0; i < MAX_ROUTES; i++) {
-        routes[i].routeID = i;
-        routes[i].bookedCount = 0;
-        routes[i].isActive = 0;
-        for(int j = 0; j < TOTAL_SEATS; j++) {
-            routes[i].seats[j] = 0;
-        }
-    }
-    
-    routeCount = 0;
-    bookedSeats = 0;
-    paymentCount = 0;
-}
-
-void initializeUsers() {
-    if(userCount == 0) {
-        strcpy(users[0].username, "testuser");
-        strcpy(users[0].password, "password");
-        users[0].isActive = 1;
-        userCount = 1;
-    }
-}
-
-int findOrCreateRoute(char source[], char destination[]) {
-    for(int i = 0; i < routeCount; i++) {
-        if(strcasecmp(routes[i].source, source) == 0 && 
-           strcasecmp(routes[i].destination, destination) == 0) {
-            return i;
-        }
-    }
-    
-    if(routeCount >= MAX_ROUTES) {
-        printf("Maximum routes reached!\n");
-        return -1;
-    }
-    
-    int routeIndex = routeCount;
-    routes[routeIndex].routeID = routeCount;
-    strcpy(routes[routeIndex].source, source);
-    strcpy(routes[routeIndex].destination, destination);
-    
-    if(routeCount == 0) {
-        strcpy(routes[routeIndex].busTime, "08:00");
-    } else {
-        int hour = rand() % 6 + 6;
-        int minute = rand() % 60;
-        sprintf(routes[routeIndex].busTime, "%02d:%02d", hour, minute);
-    }
-    
-    routes[routeIndex].bookedCount = 0;
-    routes[routeIndex].isActive = 1;
-    
-    for(int i = 0; i < TOTAL_SEATS; i++) {
-        routes[routeIndex].seats[i] = 0;
-    }
-    
-    routeCount++;
-    printf("New route created: %s to %s at %s\n", source, destination, routes[routeIndex].busTime);
-    return routeIndex;
-}
-
-void viewAvailableSeatsForRoute(char source[], char destination[]) {
-    int routeIndex = findOrCreateRoute(source, destination);
-    if(routeIndex == -1) return;
-    
-    printf("\n=== AVAILABLE SEATS FOR %s to %s ===\n", source, destination);
-    printf("Bus Time: %s\n", routes[routeIndex].busTime);
-    printf("Available Seats: %d/%d\n", TOTAL_SEATS - routes[routeIndex].bookedCount, TOTAL_SEATS);
-    
-    int availableCount = 0;
-    for(int i = 0; i < TOTAL_SEATS; i++) {
-        if(routes[routeIndex].seats[i] == 0) {
-            printf("Seat %02d ", i + 1);
-            availableCount++;
-            
-            if((availableCount) % 4 == 0) {
-                printf("\n");
-            }
-        }
-    }
-    
-    if(availableCount == 0) {
-        printf("No available seats on this bus!\n");
-        
-        char nextBusChoice;
-        printf("Next bus available in 1 hour. Would you like to book on next bus? (y/n): ");
-        scanf("%c", &nextBusChoice);
-        clearInputBuffer();
-        
-        if(tolower(nextBusChoice) == 'y') {
-            int nextRouteIndex = routeCount;
-            if(nextRouteIndex >= MAX_ROUTES) {
-                printf("Cannot create more routes!\n");
-                return;
-            }
-            
-            routes[nextRouteIndex].routeID = routeCount;
-            strcpy(routes[nextRouteIndex].source, source);
-            strcpy(routes[nextRouteIndex].destination, destination);
-            
-            int hour, minute;
-            sscanf(routes[routeIndex].busTime, "%d:%d", &hour, &minute);
-            hour = (hour + 1) % 24;
-            sprintf(routes[nextRouteIndex].busTime, "%02d:%02d", hour, minute);
-            
-            routes[nextRouteIndex].bookedCount = 0;
-            routes[nextRouteIndex].isActive = 1;
-            
-            for(int i = 0; i < TOTAL_SEATS; i++) {
-                routes[nextRouteIndex].seats[i] = 0;
-            }
-            
-            routeCount++;
-            printf("Next bus created at %s\n", routes[nextRouteIndex].busTime);
-            viewAvailableSeatsForRoute(source, destination);
-        }
-    } else {
-        if(availableCount % 4 != 0) {
-            printf("\n");
-        }
-    }
-}
-
-void bookTicket() {
-    char source[SOURCE_LENGTH];
-    char destination[DESTINATION_LENGTH];
-    
-    printf("\n=== BOOK TICKET ===\n");
-    printf("Enter source: ");
-    fgets(source, SOURCE_LENGTH, stdin);
-    source[strcspn(source, "\n")] = 0;
-    
-    printf("Enter destination: ");
-    fgets(destination, DESTINATION_LENGTH, stdin);
-    destination[strcspn(destination, "\n")] = 0;
-    
-    int routeIndex = findOrCreateRoute(source, destination);
-    if(routeIndex == -1) return;
-    
-    viewAvailableSeatsForRoute(source, destination);
-    
-    if(routes[routeIndex].bookedCount >= TOTAL_SEATS) {
-        return;
-    }
-    
-    int seatNumber;
-    printf("\nEnter seat number to book: ");
-    scanf("%d", &seatNumber);
-    clearInputBuffer();
-    
-    if(seatNumber < 1 || seatNumber > TOTAL_SEATS) {
-        printf("Invalid seat number! Please enter between 1 and %d.\n", TOTAL_SEATS);
-        return;
-    }
-    
-    if(routes[routeIndex].seats[seatNumber - 1] == 1) {
-        printf("Seat %d is already booked on this bus!\n", seatNumber);
-        return;
-    }
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(!bookings[i].isBooked) {
-            bookings[i].seatNo = seatNumber;
-            bookings[i].routeID = routeIndex;
-            
-            printf("Enter passenger name: ");
-            fgets(bookings[i].name, NAME_LENGTH, stdin);
-            bookings[i].name[strcspn(bookings[i].name, "\n")] = 0;
-            
-            printf("Enter phone number: ");
-            fgets(bookings[i].phone, PHONE_LENGTH, stdin);
-            bookings[i].phone[strcspn(bookings[i].phone, "\n")] = 0;
-            
-            routes[routeIndex].seats[seatNumber - 1] = 1;
-            routes[routeIndex].bookedCount++;
-            bookings[i].isBooked = 1;
-            bookedSeats++;
-            
-            processPayment(i, routeIndex);
-            
-            printf("\nTicket booked successfully!\n");
-            printTicket(seatNumber, routeIndex);
-            return;
-        }
-    }
-    
-    printf("Booking system error!\n");
-}
-
-void processPayment(int bookingIndex, int routeIndex) {
-    printf("\n=== PAYMENT ===\n");
-    printf("Base Fare: %.2f\n", BASE_FARE);
-    printf("\nSelect payment method:\n");
-    printf("1. Bkash (2%% fee)\n");
-    printf("2. Nagad (1.5%% fee)\n");
-    printf("3. Rocket (1%% fee)\n");
-    printf("4. Card (1.8%% fee)\n");
-    printf("5. Cash (0%% fee)\n");
-    printf("Enter choice (1-5): ");
-    
-    int choice;
-    scanf("%d", &choice);
-    clearInputBuffer();
-    
-    char method[20];
-    float feePercent;
-    
-    switch(choice) {
-        case 1:
-            strcpy(method, "Bkash");
-            feePercent = 2.0;
-            break;
-        case 2:
-            strcpy(method, "Nagad");
-            feePercent = 1.5;
-            break;
-        case 3:
-            strcpy(method, "Rocket");
-            feePercent = 1.0;
-            break;
-        case 4:
-            strcpy(method, "Card");
-            feePercent = 1.8;
-            break;
-        case 5:
-            strcpy(method, "Cash");
-            feePercent = 0.0;
-            break;
-        default:
-            printf("Invalid choice! Using Cash.\n");
-            strcpy(method, "Cash");
-            feePercent = 0.0;
-    }
-    
-    float amount = BASE_FARE;
-    float fee = (amount * feePercent) / 100.0;
-    float total = amount + fee;
-    
-    payments[paymentCount].paymentID = paymentCount;
-    strcpy(payments[paymentCount].method, method);
-    payments[paymentCount].amount = amount;
-    payments[paymentCount].feePercent = feePercent;
-    payments[paymentCount].totalPaid = total;
-    strcpy(payments[paymentCount].status, "Completed");
-    
-    if(strcmp(method, "Cash") != 0) {
-        generateTransactionID(payments[paymentCount].transactionID);
-        printf("Transaction ID: %s\n", payments[paymentCount].transactionID);
-    } else {
-        strcpy(payments[paymentCount].transactionID, "CASH");
-    }
-    
-    bookings[bookingIndex].paymentID = paymentCount;
-    paymentCount++;
-    
-    printf("\nPayment Summary:\n");
-    printf("Method: %s\n", method);
-    printf("Base Fare: %.2f\n", amount);
-    printf("Fee (%.1f%%): %.2f\n", feePercent, fee);
-    printf("Total Paid: %.2f\n", total);
-    printf("Status: %s\n", payments[paymentCount-1].status);
-}
-
-void generateTransactionID(char transID[]) {
-    time_t t = time(NULL);
-    sprintf(transID, "TXN%ld%03d", t, rand() % 1000);
-}
-
-void userSignup() {
-    if(userCount >= MAX_USERS) {
-        printf("Maximum user limit reached!\n");
-        return;
-    }
-    
-    char username[USERNAME_LENGTH];
-    char password[PASSWORD_LENGTH];
-    char confirmPassword[PASSWORD_LENGTH];
-    
-    printf("\n=== USER SIGNUP ===\n");
-    printf("Enter username: ");
-    fgets(username, USERNAME_LENGTH, stdin);
-    username[strcspn(username, "\n")] = 0;
-    
-    for(int i = 0; i < userCount; i++) {
-        if(strcmp(users[i].username, username) == 0) {
-            printf("Username already exists! Please choose another.\n");
-            return;
-        }
-    }
-    
-    printf("Enter password: ");
-    fgets(password, PASSWORD_LENGTH, stdin);
-    password[strcspn(password, "\n")] = 0;
-    
-    printf("Confirm password: ");
-    fgets(confirmPassword, PASSWORD_LENGTH, stdin);
-    confirmPassword[strcspn(confirmPassword, "\n")] = 0;
-    
-    if(strcmp(password, confirmPassword) != 0) {
-        printf("Passwords do not match!\n");
-        return;
-    }
-    
-    strcpy(users[userCount].username, username);
-    strcpy(users[userCount].password, password);
-    users[userCount].isActive = 1;
-    userCount++;
-    
-    printf("User registered successfully!\n");
-    saveUserData();
-}
-
-void userLogin() {
-    char username[USERNAME_LENGTH];
-    char password[PASSWORD_LENGTH];
-    
-    printf("\n=== USER LOGIN ===\n");
-    printf("Enter username: ");
-    fgets(username, USERNAME_LENGTH, stdin);
-    username[strcspn(username, "\n")] = 0;
-    
-    printf("Enter password: ");
-    fgets(password, PASSWORD_LENGTH, stdin);
-    password[strcspn(password, "\n")] = 0;
-    
-    for(int i = 0; i < userCount; i++) {
-        if(strcmp(users[i].username, username) == 0 && 
-           strcmp(users[i].password, password) == 0) {
-            currentUserIndex = i;
-            printf("Login successful! Welcome %s\n", username);
-            userMenu();
-            return;
-        }
-    }
-    
-    printf("Invalid username or password!\n");
-}
-
-void userMenu() {
-    int choice;
-    
-    do {
-        printf("\n=== USER MENU ===\n");
-        printf("1. Book a Ticket\n");
-        printf("2. Edit My Reservation\n");
-        printf("3. Cancel My Reservation\n");
-        printf("4. Print My Ticket\n");
-        printf("5. View All Bookings\n");
-        printf("6. Logout\n");
-        printf("=================\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clearInputBuffer();
-        
-        switch(choice) {
-            case 1:
-                bookTicket();
-                break;
-            case 2:
-                editReservation();
-                break;
-            case 3:
-                cancelReservation();
-                break;
-            case 4:
-                {
-                    int seatNumber;
-                    printf("Enter your seat number: ");
-                    scanf("%d", &seatNumber);
-                    clearInputBuffer();
-                    
-                    int routeIndex = -1;
-                    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-                        if(bookings[i].isBooked && bookings[i].seatNo == seatNumber) {
-                            routeIndex = bookings[i].routeID;
-                            break;
-                        }
-                    }
-                    
-                    if(routeIndex != -1) {
-                        printTicket(seatNumber, routeIndex);
-                    } else {
-                        printf("Ticket not found!\n");
-                    }
-                }
-                break;
-            case 5:
-                viewAllBookings();
-                break;
-            case 6:
-                printf("Logged out successfully!\n");
-                currentUserIndex = -1;
-                break;
-            default:
-                printf("Invalid choice! Please try again.\n");
-        }
-    } while(choice != 6 && currentUserIndex != -1);
-}
-
-int authenticateAdmin() {
-    char username[USERNAME_LENGTH];
-    char password[PASSWORD_LENGTH];
-    
-    printf("\n=== ADMIN LOGIN ===\n");
-    printf("Enter admin username: ");
-    fgets(username, USERNAME_LENGTH, stdin);
-    username[strcspn(username, "\n")] = 0;
-    
-    printf("Enter admin password: ");
-    fgets(password, PASSWORD_LENGTH, stdin);
-    password[strcspn(password, "\n")] = 0;
-    
-    if(strcmp(username, "admin") == 0 && strcmp(password, "admin123") == 0) {
-        printf("Admin login successful!\n");
-        return 1;
-    }
-    
-    printf("Invalid admin credentials!\n");
-    return 0;
-}
-
-void adminPanel() {
-    int choice;
-    
-    do {
-        printf("\n=== ADMIN PANEL ===\n");
-        printf("1. Search Passenger by Phone\n");
-        printf("2. Search Passenger by Destination\n");
-        printf("3. View All Passenger Details\n");
-        printf("4. Cancel Passenger Reservation\n");
-        printf("5. Print Passenger Ticket\n");
-        printf("6. View All Routes\n");
-        printf("7. Admin Logout\n");
-        printf("===================\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-        clearInputBuffer();
-        
-        switch(choice) {
-            case 1:
-                adminSearchByPhone();
-                break;
-            case 2:
-                adminSearchByDestination();
-                break;
-            case 3:
-                adminViewPassengerDetails();
-                break;
-            case 4:
-                adminCancelReservation();
-                break;
-            case 5:
-                adminPrintTicket();
-                break;
-            case 6:
-                {
-                    printf("\n=== ALL ACTIVE ROUTES ===\n");
-                    for(int i = 0; i < routeCount; i++) {
-                        if(routes[i].isActive) {
-                            printf("Route %d: %s to %s | Time: %s | Booked: %d/%d\n",
-                                   routes[i].routeID, routes[i].source, routes[i].destination,
-                                   routes[i].busTime, routes[i].bookedCount, TOTAL_SEATS);
-                        }
-                    }
-                }
-                break;
-            case 7:
-                adminLogout();
-                break;
-            default:
-                printf("Invalid choice! Please try again.\n");
-        }
-    } while(choice != 7);
-}
-
-void adminSearchByPhone() {
-    char phone[PHONE_LENGTH];
-    
-    printf("\n=== SEARCH BY PHONE NUMBER ===\n");
-    printf("Enter phone number: ");
-    fgets(phone, PHONE_LENGTH, stdin);
-    phone[strcspn(phone, "\n")] = 0;
-    
-    printf("\n=== SEARCH RESULTS ===\n");
-    int found = 0;
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && strcmp(bookings[i].phone, phone) == 0) {
-            found = 1;
-            int routeIndex = bookings[i].routeID;
-            int paymentID = bookings[i].paymentID;
-            
-            printf("\nPassenger Details:\n");
-            printf("Name: %s\n", bookings[i].name);
-            printf("Phone: %s\n", bookings[i].phone);
-            printf("Seat: %d\n", bookings[i].seatNo);
-            printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-            printf("Bus Time: %s\n", routes[routeIndex].busTime);
-            
-            if(paymentID != -1) {
-                printf("\nPayment Details:\n");
-                printf("Method: %s\n", payments[paymentID].method);
-                printf("Transaction ID: %s\n", payments[paymentID].transactionID);
-                printf("Amount: %.2f\n", payments[paymentID].amount);
-                printf("Fee: %.2f (%.1f%%)\n", 
-                       payments[paymentID].totalPaid - payments[paymentID].amount,
-                       payments[paymentID].feePercent);
-                printf("Total Paid: %.2f\n", payments[paymentID].totalPaid);
-                printf("Status: %s\n", payments[paymentID].status);
-            }
-            printf("-----------------------------\n");
-        }
-    }
-    
-    if(!found) {
-        printf("No passenger found with phone number: %s\n", phone);
-    }
-}
-
-void showDestinationHints(char partialDest[]) {
-    char uniqueDests[MAX_ROUTES][DESTINATION_LENGTH];
-    int destCount = 0;
-    
-    for(int i = 0; i < routeCount; i++) {
-        if(routes[i].isActive) {
-            int exists = 0;
-            for(int j = 0; j < destCount; j++) {
-                if(strcasecmp(uniqueDests[j], routes[i].destination) == 0) {
-                    exists = 1;
-                    break;
-                }
-            }
-            if(!exists) {
-                strcpy(uniqueDests[destCount], routes[i].destination);
-                destCount++;
-            }
-        }
-    }
-    
-    printf("\nDid you mean? (Destinations starting with '%s'):\n", partialDest);
-    int hints = 0;
-    for(int i = 0; i < destCount; i++) {
-        if(strncasecmp(uniqueDests[i], partialDest, strlen(partialDest)) == 0) {
-            printf("- %s\n", uniqueDests[i]);
-            hints++;
-        }
-    }
-    
-    if(hints == 0) {
-        printf("No matching destinations found.\n");
-        printf("Available destinations:\n");
-        for(int i = 0; i < destCount; i++) {
-            printf("- %s\n", uniqueDests[i]);
-        }
-    }
-}
-
-void adminSearchByDestination() {
-    char destination[DESTINATION_LENGTH];
-    
-    printf("\n=== SEARCH BY DESTINATION ===\n");
-    printf("Enter destination: ");
-    fgets(destination, DESTINATION_LENGTH, stdin);
-    destination[strcspn(destination, "\n")] = 0;
-    
-    int exactMatch = 0;
-    for(int i = 0; i < routeCount; i++) {
-        if(routes[i].isActive && strcasecmp(routes[i].destination, destination) == 0) {
-            exactMatch = 1;
-            break;
-        }
-    }
-    
-    if(!exactMatch) {
-        printf("\nNo exact match found for destination: %s\n", destination);
-        showDestinationHints(destination);
-        
-        printf("\nEnter correct destination from list above: ");
-        fgets(destination, DESTINATION_LENGTH, stdin);
-        destination[strcspn(destination, "\n")] = 0;
-    }
-    
-    printf("\n=== PASSENGERS GOING TO %s ===\n", destination);
-    int found = 0;
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked) {
-            int routeIndex = bookings[i].routeID;
-            if(routeIndex != -1 && strcasecmp(routes[routeIndex].destination, destination) == 0) {
-                found = 1;
-                int paymentID = bookings[i].paymentID;
-                
-                printf("\nPassenger %d:\n", found);
-                printf("Name: %s\n", bookings[i].name);
-                printf("Phone: %s\n", bookings[i].phone);
-                printf("Seat: %d\n", bookings[i].seatNo);
-                printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-                printf("Bus Time: %s\n", routes[routeIndex].busTime);
-                
-                if(paymentID != -1) {
-                    printf("Payment: %s (TXN: %s)\n", payments[paymentID].method, payments[paymentID].transactionID);
-                    printf("Amount: %.2f (Fee: %.1f%%)\n", payments[paymentID].totalPaid, payments[paymentID].feePercent);
-                }
-                printf("-----------------------------\n");
-            }
-        }
-    }
-    
-    if(!found) {
-        printf("No passengers found going to %s\n", destination);
-    }
-}
-
-void adminViewPassengerDetails() {
-    printf("\n=== ALL PASSENGER DETAILS ===\n");
-    
-    if(bookedSeats == 0) {
-        printf("No bookings found.\n");
-        return;
-    }
-    
-    int count = 0;
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked) {
-            count++;
-            int routeIndex = bookings[i].routeID;
-            int paymentID = bookings[i].paymentID;
-            
-            printf("\nPassenger %d:\n", count);
-            printf("Name: %s\n", bookings[i].name);
-            printf("Phone: %s\n", bookings[i].phone);
-            printf("Seat: %d\n", bookings[i].seatNo);
-            
-            if(routeIndex != -1) {
-                printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-                printf("Bus Time: %s\n", routes[routeIndex].busTime);
-            }
-            
-            if(paymentID != -1) {
-                printf("Payment: %s | TXN: %s\n", payments[paymentID].method, payments[paymentID].transactionID);
-                printf("Paid: %.2f (Fee: %.1f%%)\n", payments[paymentID].totalPaid, payments[paymentID].feePercent);
-            }
-            printf("-----------------------------\n");
-        }
-    }
-    
-    printf("Total passengers: %d\n", count);
-}
-
-void adminCancelReservation() {
-    int seatNumber;
-    char destination[DESTINATION_LENGTH];
-    
-    printf("\n=== CANCEL RESERVATION ===\n");
-    printf("Enter destination: ");
-    fgets(destination, DESTINATION_LENGTH, stdin);
-    destination[strcspn(destination, "\n")] = 0;
-    
-    printf("Enter seat number: ");
-    scanf("%d", &seatNumber);
-    clearInputBuffer();
-    
-    int found = 0;
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && bookings[i].seatNo == seatNumber) {
-            int routeIndex = bookings[i].routeID;
-            if(routeIndex != -1 && strcasecmp(routes[routeIndex].destination, destination) == 0) {
-                found = 1;
-                
-                printf("\nFound passenger:\n");
-                printf("Name: %s\n", bookings[i].name);
-                printf("Phone: %s\n", bookings[i].phone);
-                printf("Seat: %d\n", bookings[i].seatNo);
-                printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-                
-                char confirm;
-                printf("Are you sure you want to cancel? (y/n): ");
-                scanf("%c", &confirm);
-                clearInputBuffer();
-                
-                if(tolower(confirm) == 'y') {
-                    bookings[i].isBooked = 0;
-                    routes[routeIndex].seats[seatNumber - 1] = 0;
-                    routes[routeIndex].bookedCount--;
-                    bookedSeats--;
-                    
-                    printf("Reservation canceled successfully.\n");
-                } else {
-                    printf("Cancellation aborted.\n");
-                }
-                return;
-            }
-        }
-    }
-    
-    if(!found) {
-        printf("No reservation found for seat %d to %s\n", seatNumber, destination);
-    }
-}
-
-void adminPrintTicket() {
-    int seatNumber;
-    char destination[DESTINATION_LENGTH];
-    
-    printf("\n=== PRINT PASSENGER TICKET ===\n");
-    printf("Enter destination: ");
-    fgets(destination, DESTINATION_LENGTH, stdin);
-    destination[strcspn(destination, "\n")] = 0;
-    
-    printf("Enter seat number: ");
-    scanf("%d", &seatNumber);
-    clearInputBuffer();
-    
-    int found = 0;
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && bookings[i].seatNo == seatNumber) {
-            int routeIndex = bookings[i].routeID;
-            if(routeIndex != -1 && strcasecmp(routes[routeIndex].destination, destination) == 0) {
-                found = 1;
-                printTicket(seatNumber, routeIndex);
-                return;
-            }
-        }
-    }
-    
-    if(!found) {
-        printf("No booking found for seat %d to %s\n", seatNumber, destination);
-    }
-}
-
-void adminSetBusDetails() {
-    char source[SOURCE_LENGTH];
-    char destination[DESTINATION_LENGTH];
-    
-    printf("\n=== SET BUS DETAILS ===\n");
-    printf("Enter source: ");
-    fgets(source, SOURCE_LENGTH, stdin);
-    source[strcspn(source, "\n")] = 0;
-    
-    printf("Enter destination: ");
-    fgets(destination, DESTINATION_LENGTH, stdin);
-    destination[strcspn(destination, "\n")] = 0;
-    
-    int routeIndex = -1;
-    for(int i = 0; i < routeCount; i++) {
-        if(strcasecmp(routes[i].source, source) == 0 && 
-           strcasecmp(routes[i].destination, destination) == 0) {
-            routeIndex = i;
-            break;
-        }
-    }
-    
-    if(routeIndex == -1) {
-        printf("Route not found!\n");
-        return;
-    }
-    
-    printf("Current bus time: %s\n", routes[routeIndex].busTime);
-    printf("Enter new bus time (HH:MM): ");
-    fgets(routes[routeIndex].busTime, TIME_LENGTH, stdin);
-    routes[routeIndex].busTime[strcspn(routes[routeIndex].busTime, "\n")] = 0;
-    
-    printf("Bus time updated to %s\n", routes[routeIndex].busTime);
-}
-
-void adminLogout() {
-    printf("Admin logged out successfully!\n");
-}
-
-void editReservation() {
-    char phone[PHONE_LENGTH];
-    
-    printf("\n=== EDIT RESERVATION ===\n");
-    printf("Enter your phone number: ");
-    fgets(phone, PHONE_LENGTH, stdin);
-    phone[strcspn(phone, "\n")] = 0;
-    
-    int found = 0;
-    int bookingIndex = -1;
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && strcmp(bookings[i].phone, phone) == 0) {
-            found = 1;
-            bookingIndex = i;
-            break;
-        }
-    }
-    
-    if(!found) {
-        printf("No reservation found with phone number: %s\n", phone);
-        return;
-    }
-    
-    printf("\nCurrent Details:\n");
-    printf("Name: %s\n", bookings[bookingIndex].name);
-    printf("Phone: %s\n", bookings[bookingIndex].phone);
-    
-    int routeIndex = bookings[bookingIndex].routeID;
-    if(routeIndex != -1) {
-        printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-    }
-    
-    printf("\nEnter new details:\n");
-    printf("Enter new Name: ");
-    fgets(bookings[bookingIndex].name, NAME_LENGTH, stdin);
-    bookings[bookingIndex].name[strcspn(bookings[bookingIndex].name, "\n")] = 0;
-    
-    printf("Enter new Phone: ");
-    fgets(bookings[bookingIndex].phone, PHONE_LENGTH, stdin);
-    bookings[bookingIndex].phone[strcspn(bookings[bookingIndex].phone, "\n")] = 0;
-    
-    printf("Reservation edited successfully.\n");
-}
-
-void cancelReservation() {
-    char phone[PHONE_LENGTH];
-    
-    printf("\n=== CANCEL RESERVATION ===\n");
-    printf("Enter your phone number: ");
-    fgets(phone, PHONE_LENGTH, stdin);
-    phone[strcspn(phone, "\n")] = 0;
-    
-    int found = 0;
-    int bookingIndex = -1;
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && strcmp(bookings[i].phone, phone) == 0) {
-            found = 1;
-            bookingIndex = i;
-            break;
-        }
-    }
-    
-    if(!found) {
-        printf("No reservation found with phone number: %s\n", phone);
-        return;
-    }
-    
-    printf("\nYour Booking Details:\n");
-    printf("Name: %s\n", bookings[bookingIndex].name);
-    printf("Phone: %s\n", bookings[bookingIndex].phone);
-    printf("Seat: %d\n", bookings[bookingIndex].seatNo);
-    
-    int routeIndex = bookings[bookingIndex].routeID;
-    if(routeIndex != -1) {
-        printf("Route: %s to %s\n", routes[routeIndex].source, routes[routeIndex].destination);
-        printf("Bus Time: %s\n", routes[routeIndex].busTime);
-    }
-    
-    char confirm;
-    printf("Are you sure you want to cancel? (y/n): ");
-    scanf("%c", &confirm);
-    clearInputBuffer();
-    
-    if(tolower(confirm) == 'y') {
-        bookings[bookingIndex].isBooked = 0;
-        
-        if(routeIndex != -1) {
-            routes[routeIndex].seats[bookings[bookingIndex].seatNo - 1] = 0;
-            routes[routeIndex].bookedCount--;
-        }
-        
-        bookedSeats--;
-        printf("Your reservation canceled successfully.\n");
-    } else {
-        printf("Cancellation aborted.\n");
-    }
-}
-
-void viewAllBookings() {
-    printf("\n=== ALL BOOKINGS ===\n");
-    
-    if(bookedSeats == 0) {
-        printf("No bookings found.\n");
-        return;
-    }
-    
-    int count = 0;
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked) {
-            count++;
-            int routeIndex = bookings[i].routeID;
-            
-            printf("%d. Seat %02d | %s | ", count, bookings[i].seatNo, bookings[i].name);
-            if(routeIndex != -1) {
-                printf("%s to %s | %s", routes[routeIndex].source, routes[routeIndex].destination, routes[routeIndex].busTime);
-            }
-            printf("\n");
-        }
-    }
-    
-    printf("Total bookings: %d\n", count);
-}
-
-void printTicket(int seatNumber, int routeIndex) {
-    printf("\n");
-    printf("=========================================\n");
-    printf("           TRANSPORT TICKET\n");
-    printf("=========================================\n");
-    
-    for(int i = 0; i < TOTAL_SEATS * MAX_ROUTES; i++) {
-        if(bookings[i].isBooked && bookings[i].seatNo == seatNumber && bookings[i].routeID == routeIndex) {
-            printf(" Passenger:   %s\n", bookings[i].name);
-            printf(" Phone:       %s\n", bookings[i].phone);
-            printf(" Seat:        %d\n", seatNumber);
-            
-            if(routeIndex != -1) {
-                printf(" From:        %s\n", routes[routeIndex].source);
-                printf(" To:          %s\n", routes[routeIndex].destination);
-                printf(" Bus Time:    %s\n", routes[routeIndex].busTime);
-            }
-            
-            int paymentID = bookings[i].paymentID;
-            if(paymentID != -1) {
-                printf(" Payment:     %s\n", payments[paymentID].method);
-                printf(" TXN ID:      %s\n", payments[paymentID].transactionID);
-                printf(" Amount:      %.2f\n", payments[paymentID].totalPaid);
-                printf(" Status:      CONFIRMED\n");
-            }
-            break;
-        }
-    }
-    
-    printf("=========================================\n");
-    printf("    Thank you for choosing our service!\n");
-    printf("=========================================\n\n");
-}
-
-void saveUserData() {
-    FILE *file = fopen("users.dat", "wb");
-    if(file != NULL) {
-        fwrite(&userCount, sizeof(int), 1, file);
-        fwrite(users, sizeof(User), userCount, file);
-        fclose(file);
-    }
-}
-
-void loadUserData() {
-    FILE *file = fopen("users.dat", "rb");
-    if(file != NULL) {
-        fread(&userCount, sizeof(int), 1, file);
-        fread(users, sizeof(User), userCount, file);
-        fclose(file);
-    }
-}
-
-void saveRoutesData() {
-    FILE *file = fopen("routes.dat", "wb");
-    if(file != NULL) {
-        fwrite(&routeCount, sizeof(int), 1, file);
-        fwrite(routes, sizeof(Route), routeCount, file);
-        
-        fwrite(&bookedSeats, sizeof(int), 1, file);
-        fwrite(&paymentCount, sizeof(int), 1, file);
-        
-        fwrite(bookings, sizeof(Booking), TOTAL_SEATS * MAX_ROUTES, file);
-        fwrite(payments, sizeof(Payment), paymentCount, file);
-        fclose(file);
-    }
-}
-
-void loadRoutesData() {
-    FILE *file = fopen("routes.dat", "rb");
-    if(file != NULL) {
-        fread(&routeCount, sizeof(int), 1, file);
-        fread(routes, sizeof(Route), routeCount, file);
-        
-        fread(&bookedSeats, sizeof(int), 1, file);
-        fread(&paymentCount, sizeof(int), 1, file);
-        
-        fread(bookings, sizeof(Booking), TOTAL_SEATS * MAX_ROUTES, file);
-        fread(payments, sizeof(Payment), paymentCount, file);
-        fclose(file);
-    }
-}
-
-void clearInputBuffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
-}
\ No newline at end of file
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Building with -DTTBS_BENCH counts every allocation made in this file so
+// --bench can report allocations per operation; the wrappers live at the end
+// of the file. Other builds call the C library directly and --bench leaves
+// that column blank.
+#ifdef TTBS_BENCH
+void *countedMalloc(size_t size);
+void *countedCalloc(size_t count, size_t size);
+void *countedRealloc(void *pointer, size_t size);
+#define malloc(size) countedMalloc(size)
+#define calloc(count, size) countedCalloc(count, size)
+#define realloc(pointer, size) countedRealloc(pointer, size)
+#endif
+
+#define TOTAL_SEATS 40
+#define SEAT_WORDS 2
+#define MAX_SEATS_PER_ROUTE (SEAT_WORDS * 64)
+#define NAME_LENGTH 50
+#define SOURCE_LENGTH 30
+#define DESTINATION_LENGTH 30
+#define CITY_LENGTH 30
+#define TIME_LENGTH 10
+#define MINUTES_PER_DAY (24 * 60)
+#define DEFAULT_DEPARTURE_MINUTE (8 * 60)
+#define DEFAULT_TRIP_MINUTES 180
+#define TRANSFER_MINUTES 15
+#define MAX_JOURNEY_LEGS 4
+#define JOURNEY_TIME_LENGTH 16
+#define USERNAME_LENGTH 20
+#define PASSWORD_LENGTH 20
+#define INITIAL_USER_CAPACITY 128
+#define INITIAL_ROUTE_CAPACITY 64
+#define INITIAL_BOOKING_CAPACITY 256
+#define BOOKING_SCAN_BATCH 256
+#define INITIAL_PAYMENT_CAPACITY 256
+#define INITIAL_HOLD_CAPACITY 256
+#define HOLD_TICK_MS 100
+#define HOLD_WHEEL_BITS 6
+#define HOLD_WHEEL_SLOTS (1 << HOLD_WHEEL_BITS)
+#define HOLD_WHEEL_LEVELS 4
+#define HOLD_DEFAULT_SECONDS 120
+#define HOLD_MAX_SECONDS 3600
+#define HOLD_GENERATION_MASK 0x7FFFFFFFu
+#define GROUP_CLAIM_ATTEMPTS 8
+#define MAX_DESTINATION_HINTS 10
+#define DATA_FILE_MAGIC "TTBSDATA"
+#define DATA_FILE_VERSION 7
+#define DATA_FILE_ENDIAN_MARK 0x01020304u
+#define DATA_SECTION_ALIGN 64
+#define JOURNAL_MAGIC 0x4C4E524Au
+#define USER_SNAPSHOT_MAGIC 0x52455355u
+#define USER_SNAPSHOT_VERSION 2
+#define USER_SNAPSHOT_LEGACY_VERSION 1
+#define USER_LOG_MAGIC 0x32474C55u
+#define USER_LOG_LEGACY_MAGIC 0x474F4C55u
+#define USER_LOG_COMPACT_RECORDS 256
+#define BATCH_GROUP_COMMIT_RECORDS 4096
+#define BATCH_LINE_LENGTH 512
+#define BATCH_MAX_FIELDS 8
+#define BATCH_FLUSH_BYTES (1 << 16)
+#define SERVER_DEFAULT_PORT 7070
+#define SERVER_SOCKET_PATH "ttbs.sock"
+#define SERVER_MAX_WORKERS 64
+#define SERVER_MAX_EVENTS 64
+#define SERVER_TICK_MS 100
+#define SERVER_OUTPUT_LIMIT (1 << 20)
+#define SERVER_AUTH_THREADS 2
+#define BENCH_DEFAULT_ROUTES 1000
+#define BENCH_DEFAULT_BOOKINGS 20000
+#define BENCH_DEFAULT_ITERATIONS 200000
+#define BENCH_DATA_PATH "bench-routes.dat"
+#define PATH_LENGTH 256
+#define LOADGEN_DEFAULT_THREADS 8
+#define LOADGEN_DEFAULT_SECONDS 10
+#define LOADGEN_DEFAULT_ROUTES 200
+#define LOADGEN_MAX_THREADS 256
+#define LOADGEN_BOOK_PERCENT 55
+#define LOADGEN_CANCEL_PERCENT 25
+#define LOADGEN_EDIT_PERCENT 10
+#define LOADGEN_BOOK_ATTEMPTS 3
+#define LOADGEN_PHONE_RANGE 100000
+#define LOADGEN_DATA_PATH "loadgen-routes.dat"
+#define LOADGEN_JOURNAL_PATH "loadgen-journal.dat"
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BUCKET_BITS)
+#define METRIC_SHARDS 16
+#define METRICS_DUMP_PATH "metrics.json"
+#define JOURNAL_GROUP_COMMIT_RECORDS 32
+#define JOURNAL_GROUP_COMMIT_MS 200
+#define JOURNAL_CHECKPOINT_RECORDS 1000
+#define ROUTE_LOCK_STRIPES 256
+#define PHONE_LENGTH 15
+#define TRANSACTION_ID_LENGTH 20
+#define TRANSACTION_EPOCH_MS INT64_C(1704067200000)
+#define TRANSACTION_NODE_BITS 4
+#define TRANSACTION_SLOT_BITS 6
+#define TRANSACTION_SEQUENCE_BITS 13
+#define TRANSACTION_SLOTS (1 << TRANSACTION_SLOT_BITS)
+#define TRANSACTION_TEXT_DIGITS 13
+#define PASSWORD_SALT_LENGTH 16
+#define PASSWORD_HASH_LENGTH 32
+#define PASSWORD_DEFAULT_ITERATIONS 100000
+#define SESSION_TOKEN_LENGTH 16
+#define SESSION_TOKEN_TEXT_LENGTH (SESSION_TOKEN_LENGTH * 2 + 1)
+#define SESSION_SLOTS 4096
+#define SESSION_TTL_SECONDS 1800
+#define MONEY_SCALE 100
+#define FEE_BASIS_POINTS 10000
+#define SETTLE_BATCH 1024
+#define REPORT_BUFFER_BYTES (1 << 20)
+#define REPORT_BLOCK_ROWS 4096
+#define REPORT_MAX_COLUMNS 16
+#define REPORT_FIELD_LENGTH 512
+#define REPORT_COLUMN_NAME_LENGTH 24
+#define REPORT_METHOD_LENGTH 16
+#define REPORT_TIMESTAMP_LENGTH 24
+#define REPORT_FILE_MAGIC "TTBSCOLS"
+#define REPORT_FILE_VERSION 1
+
+// Money is kept in integer minor units (poisha); print it with MONEY_FORMAT
+// and MONEY_ARGS, and fee rates given in basis points with RATE_FORMAT and
+// RATE_ARGS.
+#define MONEY_FORMAT "%lld.%02lld"
+#define MONEY_ARGS(minor) (long long)((minor) / MONEY_SCALE), (long long)((minor) % MONEY_SCALE)
+#define RATE_FORMAT "%d.%02d%%"
+#define RATE_ARGS(basisPoints) (basisPoints) / 100, (basisPoints) % 100
+
+// Departures are minutes after midnight; print them with DEPARTURE_FORMAT and
+// DEPARTURE_ARGS.
+#define DEPARTURE_FORMAT "%02d:%02d"
+#define DEPARTURE_ARGS(minute) (minute) / 60, (minute) % 60
+
+// METRIC_SCOPE times the rest of the enclosing block as one operation and
+// METRIC_FAILED marks that operation failed. Building with -DNO_METRICS
+// compiles both away.
+#ifndef NO_METRICS
+#define METRIC_SCOPE(metric) \
+    MetricTimer metricTimer __attribute__((cleanup(finishMetricTimer))) = startMetricTimer(metric)
+#define METRIC_FAILED() (metricTimer.failed = 1)
+#else
+#define METRIC_SCOPE(metric) ((void)0)
+#define METRIC_FAILED() ((void)0)
+#endif
+
+enum {
+    PAYMENT_BKASH,
+    PAYMENT_NAGAD,
+    PAYMENT_ROCKET,
+    PAYMENT_CARD,
+    PAYMENT_CASH,
+    PAYMENT_METHOD_COUNT
+};
+
+enum {
+    PAYMENT_PENDING,
+    PAYMENT_COMPLETED,
+    PAYMENT_STATUS_COUNT
+};
+
+typedef struct {
+    const char *name;
+    int feeBasisPoints;
+    int hasTransaction;
+} PaymentMethod;
+
+// The rate used is stored with each payment, so changing the table later
+// does not rewrite what earlier passengers were charged.
+typedef struct {
+    int paymentID;
+    int method;
+    int status;
+    int feeBasisPoints;
+    uint64_t transactionID;
+    int64_t amount;
+    int64_t fee;
+    int64_t totalPaid;
+} Payment;
+
+// Transaction IDs are 64 bits: milliseconds since TRANSACTION_EPOCH_MS, then
+// the node, then the generating slot, then a per-slot sequence. Each slot
+// hands out stamps (milliseconds and sequence together) from one counter
+// that never goes backwards, so a slot shared by several threads, a burst
+// past the sequence range or a clock step back all still yield unique,
+// increasing IDs. 0 means no transaction (cash).
+typedef struct {
+    uint64_t lastStamp;
+    uint64_t padding[7];
+} TransactionSlot;
+
+typedef struct {
+    uint64_t count;
+    int64_t amount;
+    int64_t fee;
+    int64_t totalPaid;
+} PaymentSettlement;
+
+typedef struct {
+    int routeID;
+    int sourceCity;
+    int destinationCity;
+    int departureMinute;
+    int durationMinutes;
+    int capacity;
+    uint64_t seatMap[SEAT_WORDS];
+    int isActive;
+} Route;
+
+typedef struct {
+    int seatNo;
+    char name[NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    int routeID;
+    int paymentID;
+    int isBooked;
+    int nextFree;
+    int prevSamePhone;
+    int nextSamePhone;
+    int64_t bookedAt;
+} Booking;
+
+// A seat claimed while its buyer pays. Live holds sit in one bucket of the
+// expiry wheel; free ones are chained through next. The generation changes
+// each time the entry is reused, so a stale token cannot touch a newer hold.
+typedef struct {
+    int routeIndex;
+    int seatNumber;
+    uint64_t expiresTick;
+    uint32_t generation;
+    int live;
+    int bucket;
+    int prev;
+    int next;
+} SeatHold;
+
+// Passwords are stored only as PBKDF2-HMAC-SHA256 of a per-user salt; the
+// iteration count is kept per user so raising the cost leaves old accounts
+// valid.
+typedef struct {
+    char username[USERNAME_LENGTH];
+    uint8_t salt[PASSWORD_SALT_LENGTH];
+    uint8_t passwordHash[PASSWORD_HASH_LENGTH];
+    uint32_t iterations;
+    int isActive;
+} User;
+
+// The plaintext record written by users.dat version 1 and the old log.
+typedef struct {
+    char username[USERNAME_LENGTH];
+    char password[PASSWORD_LENGTH];
+    int isActive;
+} LegacyUser;
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+} Sha256Context;
+
+typedef struct {
+    int userIndex;
+    uint8_t token[SESSION_TOKEN_LENGTH];
+    uint8_t check[PASSWORD_HASH_LENGTH];
+    time_t expires;
+} Session;
+
+typedef struct {
+    unsigned int hash;
+    int corridor;
+} RouteSlot;
+
+// One daily bus as the journey planner scans it: timetableConnections[] is
+// sorted by departure minute, so a single pass visits buses in time order.
+typedef struct {
+    int departure;
+    int arrival;
+    int sourceCity;
+    int destinationCity;
+    int routeIndex;
+} TimetableConnection;
+
+// Departure and arrival count minutes from midnight of the travel day, so a
+// leg after midnight is past MINUTES_PER_DAY.
+typedef struct {
+    int routeIndex;
+    int departure;
+    int arrival;
+} JourneyLeg;
+
+enum {
+    JOURNEY_EARLIEST_ARRIVAL,
+    JOURNEY_FEWEST_TRANSFERS
+};
+
+// Every departure between one pair of cities. departures is sorted by
+// departure minute (ties by route index) and freeSeats is a max segment tree
+// over their free seat counts, leaves from leafCount on, so the next
+// departure with enough seats is found in logarithmic time.
+typedef struct {
+    int sourceCity;
+    int destinationCity;
+    int firstRoute;
+    int *departures;
+    int departureCount;
+    int departureCapacity;
+    int *freeSeats;
+    int leafCount;
+} Corridor;
+
+typedef struct {
+    uint64_t key;
+    int head;
+    int tail;
+} PhoneSlot;
+
+enum {
+    JOURNAL_ROUTE = 1,
+    JOURNAL_BOOKING = 2,
+    JOURNAL_CANCEL = 3,
+    JOURNAL_PAYMENT = 4,
+    JOURNAL_CITY = 5
+};
+
+enum {
+    SECTION_ROUTES = 1,
+    SECTION_BOOKINGS = 2,
+    SECTION_PAYMENTS = 3,
+    SECTION_CITIES = 4,
+    SECTION_COUNT = 4
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianMark;
+    uint32_t sectionCount;
+    uint32_t headerChecksum;
+    uint64_t fileSize;
+    uint64_t journalSequence;
+} DataFileHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+    uint32_t checksum;
+    uint32_t reserved;
+} DataSection;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;
+    uint32_t count;
+    uint32_t checksum;
+    uint32_t padding;
+} UserSnapshotHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+} UserLogHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t checksum;
+    User user;
+} UserLogRecord;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t checksum;
+    LegacyUser user;
+} LegacyUserLogRecord;
+
+typedef struct {
+    User *users;
+    int count;
+    uint32_t generation;
+} UserSnapshot;
+
+enum {
+    REGISTER_TAKEN = -1,
+    REGISTER_INVALID = -2,
+    REGISTER_NO_SPACE = -3
+};
+
+enum {
+    BOOK_INVALID_SEAT = -1,
+    BOOK_SEAT_TAKEN = -2,
+    BOOK_NO_SPACE = -3,
+    BOOK_HOLD_EXPIRED = -4
+};
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} OutputBuffer;
+
+enum {
+    REPORT_BOOKINGS,
+    REPORT_ROUTES
+};
+
+enum {
+    REPORT_CSV,
+    REPORT_JSON,
+    REPORT_COLUMNAR
+};
+
+// Money is in minor units, clock values are minutes after midnight and
+// timestamps are seconds since the epoch; the columnar format stores all of
+// them as int64 and text as width bytes, zero padded.
+enum {
+    REPORT_INTEGER,
+    REPORT_TEXT,
+    REPORT_MONEY,
+    REPORT_CLOCK,
+    REPORT_TIMESTAMP
+};
+
+typedef struct {
+    const char *name;
+    int type;
+    int width;
+} ReportColumn;
+
+typedef struct {
+    int64_t number;
+    const char *text;
+} ReportValue;
+
+// Rows stream through a REPORT_BUFFER_BYTES buffer that goes to disk with
+// one write whenever it fills. The columnar format first gathers
+// REPORT_BLOCK_ROWS rows per column, then writes each column of the block
+// contiguously.
+typedef struct {
+    int fd;
+    int format;
+    const ReportColumn *columns;
+    int columnCount;
+    char *buffer;
+    size_t length;
+    char *blocks[REPORT_MAX_COLUMNS];
+    int blockRows;
+    uint64_t rows;
+    int failed;
+    int64_t lastStamp;
+    char lastStampText[REPORT_TIMESTAMP_LENGTH];
+    char path[PATH_LENGTH];
+} ReportWriter;
+
+// -1 leaves a field unfiltered; from and to bound bookedAt, to exclusive.
+typedef struct {
+    int sourceCity;
+    int destinationCity;
+    int64_t from;
+    int64_t to;
+} ReportFilter;
+
+// Columnar files start with this header and one ReportColumnRecord per
+// column, followed by blocks, each a uint32_t row count and then every
+// column's values for those rows. A block of zero rows ends the file.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianMark;
+    uint32_t columnCount;
+    uint32_t reserved;
+} ReportFileHeader;
+
+typedef struct {
+    char name[REPORT_COLUMN_NAME_LENGTH];
+    uint32_t type;
+    uint32_t width;
+} ReportColumnRecord;
+
+typedef struct {
+    int fd;
+    int listening;
+    int closing;
+    uint32_t events;
+    char input[BATCH_LINE_LENGTH];
+    size_t inputLength;
+    OutputBuffer output;
+    size_t outputSent;
+    int epollFd;
+    int authPending;
+    int authDone;
+    char authLine[BATCH_LINE_LENGTH];
+    OutputBuffer authOutput;
+} Connection;
+
+typedef struct {
+    int epollFd;
+    int index;
+    pthread_t thread;
+} ServerWorker;
+
+// Log-linear latency buckets: each power of two is split into 16 linear
+// steps, so any recorded value is within about 6% of its bucket.
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t maxNs;
+} LatencyHistogram;
+
+enum {
+    METRIC_FIND_ROUTE,
+    METRIC_BOOK,
+    METRIC_PAYMENT,
+    METRIC_CANCEL,
+    METRIC_EDIT,
+    METRIC_SEARCH_PHONE,
+    METRIC_SEARCH_DESTINATION,
+    METRIC_SAVE,
+    METRIC_LOAD,
+    METRIC_JOURNAL_SYNC,
+    METRIC_LOGIN,
+    METRIC_REPORT,
+    METRIC_PASSWORD_HASH,
+    METRIC_COUNT
+};
+
+typedef struct {
+    LatencyHistogram latency[METRIC_COUNT];
+    uint64_t elapsedNs[METRIC_COUNT];
+    uint64_t failures[METRIC_COUNT];
+} MetricShard;
+
+typedef struct {
+    int metric;
+    int failed;
+    struct timespec start;
+} MetricTimer;
+
+enum {
+    LOAD_BOOK,
+    LOAD_CANCEL,
+    LOAD_EDIT,
+    LOAD_SEARCH,
+    LOAD_OP_COUNT
+};
+
+typedef struct {
+    pthread_t thread;
+    unsigned int seed;
+    long intervalNs;
+    struct timespec deadline;
+    LatencyHistogram latency[LOAD_OP_COUNT];
+    uint64_t conflicts[LOAD_OP_COUNT];
+    uint64_t misses[LOAD_OP_COUNT];
+} LoadWorker;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t length;
+    int32_t index;
+    uint64_t sequence;
+    uint32_t checksum;
+    uint32_t padding;
+} JournalHeader;
+
+// Source and destination names are interned once as cities and routes refer
+// to them by id. routeList and bookingCount cover the routes ending in the
+// city, which is what destination search and hints work from.
+typedef struct {
+    char name[CITY_LENGTH];
+    char folded[CITY_LENGTH];
+    unsigned int hash;
+    int *routeList;
+    int routeListCount;
+    int routeListCapacity;
+    int bookingCount;
+} City;
+
+typedef struct {
+    char name[CITY_LENGTH];
+} CityRecord;
+
+Booking *bookings = NULL;
+int bookingCapacity = 0;
+int freeBookingHead = -1;
+
+// Hot columns beside bookings[]: an occupancy bitset and dense route and
+// payment ids, so full scans read a bit per booking instead of a whole
+// record. They are derived on load and change under phoneIndexLock together
+// with isBooked.
+uint64_t *bookingLive = NULL;
+int *bookingRoutes = NULL;
+int *bookingPayments = NULL;
+int bookingColumnCapacity = 0;
+User *users = NULL;
+int userCapacity = 0;
+int *userSlots = NULL;
+int userSlotCount = 0;
+uint32_t passwordIterations = PASSWORD_DEFAULT_ITERATIONS;
+
+// Sessions are cached one slot per user index (a newer user sharing the slot
+// evicts the older session). Each keeps the token handed out at login and a
+// keyed digest of the password, so resuming with the token or logging in
+// again with the same password skips PBKDF2.
+Session sessions[SESSION_SLOTS];
+uint8_t sessionKey[PASSWORD_HASH_LENGTH];
+Route *routes = NULL;
+int **seatOwners = NULL;
+int routeCapacity = 0;
+RouteSlot *routeSlots = NULL;
+int routeSlotCount = 0;
+Corridor *corridors = NULL;
+int corridorCount = 0;
+int corridorCapacity = 0;
+int *routeCorridors = NULL;
+int *departureSlots = NULL;
+int departureIndexCapacity = 0;
+TimetableConnection *timetableConnections = NULL;
+int timetableConnectionCount = 0;
+int timetableConnectionCapacity = 0;
+int *connectionSlots = NULL;
+PhoneSlot *phoneSlots = NULL;
+int phoneSlotCount = 0;
+int phoneSlotsUsed = 0;
+City *cities = NULL;
+int *cityOrder = NULL;
+int cityCount = 0;
+int cityCapacity = 0;
+int *citySlots = NULL;
+int citySlotCount = 0;
+
+const char *routesDataPath = "routes.dat";
+void *dataFileMap = NULL;
+size_t dataFileMapSize = 0;
+int routesMapped = 0;
+int bookingsMapped = 0;
+int paymentsMapped = 0;
+
+FILE *userLogFile = NULL;
+uint32_t userLogGeneration = 0;
+int userLogRecords = 0;
+pthread_t userCompactionThread;
+int userCompactionStarted = 0;
+
+const char *journalPath = "journal.dat";
+FILE *journalFile = NULL;
+uint64_t journalSequence = 0;
+uint64_t checkpointSequence = 0;
+int journalPendingSync = 0;
+int journalRecordsSinceCheckpoint = 0;
+int journalGroupCommitRecords = JOURNAL_GROUP_COMMIT_RECORDS;
+struct timespec journalLastSync;
+Payment *payments = NULL;
+int paymentCapacity = 0;
+
+// Holds expire through a hierarchical timer wheel of HOLD_WHEEL_LEVELS levels
+// of HOLD_WHEEL_SLOTS buckets. Level n buckets span 64^n ticks; reaching one
+// moves its holds down a level, so each hold is filed at most once per level.
+SeatHold *holds = NULL;
+int holdCapacity = 0;
+int holdFreeHead = -1;
+int holdWheel[HOLD_WHEEL_LEVELS * HOLD_WHEEL_SLOTS];
+uint64_t holdWheelTick = 0;
+int activeHolds = 0;
+
+// storeLock is held shared by every booking operation and exclusively while a
+// table grows, a route is created or routes.dat is checkpointed. Within a
+// shared hold, a route's striped lock orders that route's bookings, cancels
+// and journal records; seat words themselves change atomically so scans of
+// free seats need no lock. The pool, phone index and journal mutexes are leaf
+// locks, never held together; a corridor's striped timetable lock is one
+// too, guarding its free seat tree. holdLock guards the holds and their
+// wheel and is only ever followed by a timetable lock. userLock guards
+// users[], its index, the session cache and the user log; it is never held
+// with the store locks.
+pthread_rwlock_t storeLock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t routeLocks[ROUTE_LOCK_STRIPES];
+pthread_mutex_t timetableLocks[ROUTE_LOCK_STRIPES];
+pthread_mutex_t bookingPoolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t phoneIndexLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t holdLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t userLock = PTHREAD_MUTEX_INITIALIZER;
+int checkpointDue = 0;
+
+int serverStopping = 0;
+Connection serverListeners[2];
+int serverListenerCount = 0;
+
+// Connections whose login or signup line is waiting for an auth thread, as a
+// ring of authQueueCount entries starting at authQueueHead.
+Connection **authQueue = NULL;
+int authQueueHead = 0;
+int authQueueCount = 0;
+int authQueueCapacity = 0;
+int authStopping = 0;
+int authThreadCount = 0;
+pthread_mutex_t authQueueLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t authQueueReady = PTHREAD_COND_INITIALIZER;
+
+#ifdef TTBS_BENCH
+uint64_t allocationCount = 0;
+#endif
+
+int benchRoutes = 0;
+int benchBookings = 0;
+char (*benchSources)[SOURCE_LENGTH] = NULL;
+char (*benchDestinations)[DESTINATION_LENGTH] = NULL;
+char (*benchPhones)[PHONE_LENGTH] = NULL;
+int *benchRouteIndexes = NULL;
+volatile long benchSink = 0;
+
+int loadRoutes = 0;
+char (*loadSources)[SOURCE_LENGTH] = NULL;
+char (*loadDestinations)[DESTINATION_LENGTH] = NULL;
+const char *loadOperationNames[LOAD_OP_COUNT] = { "book", "cancel", "edit", "search" };
+
+// Each thread records into one of METRIC_SHARDS shards, picked round-robin on
+// its first operation, so busy workers rarely touch the same counters.
+#ifndef NO_METRICS
+MetricShard metricShards[METRIC_SHARDS];
+int nextMetricShard = 0;
+__thread int metricShard = -1;
+#endif
+const char *metricNames[METRIC_COUNT] = {
+    "find_route", "book", "payment", "cancel", "edit",
+    "search_phone", "search_destination", "save", "load", "journal_sync", "login", "report",
+    "password_hash"
+};
+
+int bookedSeats = 0;
+int userCount = 0;
+int routeCount = 0;
+int paymentCount = 0;
+int currentUserIndex = -1;
+
+int64_t BASE_FARE = 500 * MONEY_SCALE;
+
+// Indexed by method; menu choice n is method n - 1.
+static const PaymentMethod paymentMethods[PAYMENT_METHOD_COUNT] = {
+    [PAYMENT_BKASH] = { "Bkash", 200, 1 },
+    [PAYMENT_NAGAD] = { "Nagad", 150, 1 },
+    [PAYMENT_ROCKET] = { "Rocket", 100, 1 },
+    [PAYMENT_CARD] = { "Card", 180, 1 },
+    [PAYMENT_CASH] = { "Cash", 0, 0 }
+};
+static const char *paymentStatusNames[PAYMENT_STATUS_COUNT] = { "Pending", "Completed" };
+
+// One report row per booking; group bookings repeat their shared payment, so
+// totals should be summed once per payment id.
+static const ReportColumn bookingReportColumns[] = {
+    { "booking", REPORT_INTEGER, 8 },
+    { "route", REPORT_INTEGER, 8 },
+    { "source", REPORT_TEXT, CITY_LENGTH },
+    { "destination", REPORT_TEXT, CITY_LENGTH },
+    { "departure", REPORT_CLOCK, 8 },
+    { "seat", REPORT_INTEGER, 8 },
+    { "name", REPORT_TEXT, NAME_LENGTH },
+    { "phone", REPORT_TEXT, PHONE_LENGTH },
+    { "payment", REPORT_INTEGER, 8 },
+    { "method", REPORT_TEXT, REPORT_METHOD_LENGTH },
+    { "transaction", REPORT_TEXT, TRANSACTION_ID_LENGTH },
+    { "amount", REPORT_MONEY, 8 },
+    { "fee", REPORT_MONEY, 8 },
+    { "total", REPORT_MONEY, 8 },
+    { "booked_at", REPORT_TIMESTAMP, 8 }
+};
+static const ReportColumn routeReportColumns[] = {
+    { "route", REPORT_INTEGER, 8 },
+    { "source", REPORT_TEXT, CITY_LENGTH },
+    { "destination", REPORT_TEXT, CITY_LENGTH },
+    { "departure", REPORT_CLOCK, 8 },
+    { "duration", REPORT_INTEGER, 8 },
+    { "capacity", REPORT_INTEGER, 8 },
+    { "booked", REPORT_INTEGER, 8 },
+    { "free", REPORT_INTEGER, 8 }
+};
+
+TransactionSlot transactionSlots[TRANSACTION_SLOTS];
+int nextTransactionSlot = 0;
+__thread int transactionSlot = -1;
+int transactionNode = 0;
+
+void initializeSystem();
+void initializeUsers();
+pthread_mutex_t *routeLock(int routeIndex);
+pthread_mutex_t *timetableLock(int corridor);
+void acquireStoreShared();
+void acquireStoreExclusive();
+void releaseStore();
+int growWhileShared(int (*ensureCapacity)(int), int needed);
+void userSignup();
+void userLogin();
+int fillRandom(void *buffer, size_t length);
+void sha256Init(Sha256Context *context);
+void sha256Compress(uint32_t state[], const uint8_t block[]);
+void sha256Update(Sha256Context *context, const void *data, size_t length);
+void sha256Final(Sha256Context *context, uint8_t digest[]);
+void derivePasswordHash(const char password[], const uint8_t salt[], size_t saltLength,
+                        uint32_t iterations, uint8_t hash[]);
+void passwordCheck(const User *user, const char password[], uint8_t check[]);
+int digestsEqual(const uint8_t a[], const uint8_t b[], size_t length);
+int setUserPassword(User *user, const char password[]);
+void insertUserSlot(int userIndex);
+void rebuildUserIndex();
+int findUser(const char username[]);
+int registerUser(const char username[], const char password[]);
+int authenticateUser(const char username[], const char password[], uint8_t token[]);
+int resumeSession(const char username[], const char tokenText[]);
+char *formatSessionToken(const uint8_t token[], char text[]);
+int authenticateAdmin();
+void adminPanel();
+void userMenu();
+int viewAvailableSeatsForRoute(char source[], char destination[]);
+int printAvailableSeats(int routeIndex);
+void bookTicket();
+int findOrCreateRoute(char source[], char destination[]);
+int findRoute(char source[], char destination[]);
+int createRoute(char source[], char destination[], int departureMinute, int durationMinutes, int capacity);
+int addDeparture(char source[], char destination[], int departureMinute, int durationMinutes);
+int ensureRouteCapacity(int needed);
+unsigned int routeKeyHash(int sourceCity, int destinationCity);
+int routeSlotMatches(RouteSlot *slot, unsigned int hash, int sourceCity, int destinationCity);
+int findRouteByCities(int sourceCity, int destinationCity);
+int findCorridor(int sourceCity, int destinationCity);
+void insertRouteSlot(int corridor);
+void rebuildRouteSlots();
+int addCorridor(int sourceCity, int destinationCity);
+int addCorridorDeparture(int corridor, int routeIndex);
+int ensureDepartureIndexCapacity(int needed);
+int compareDepartures(const void *a, const void *b);
+void sortDepartures(int corridor);
+void refreshDeparture(int routeIndex);
+int firstDepartureWithSeats(const Corridor *corridor, int node, int low, int high, int from, int seats);
+int nextDeparture(int corridor, int minute, int seats);
+int compareConnections(const void *a, const void *b);
+int ensureConnectionCapacity(int needed);
+void rebuildConnections();
+int insertConnection(int routeIndex);
+void repositionConnection(int position);
+int planJourney(int sourceCity, int destinationCity, int minute, int seats, int mode,
+                JourneyLeg legs[], int *legCount);
+char *formatJourneyTime(int minute, char text[]);
+void planJourneyMenu();
+int indexRoute(int routeIndex);
+void rebuildRouteIndex();
+int ensureBookingCapacity(int needed);
+int allocateBooking();
+void releaseBooking(int bookingIndex);
+void rebuildBookingFreeList();
+int resizeBookingColumns(int capacity);
+void setBookingLive(int bookingIndex, int live);
+void rebuildBookingColumns();
+int scanBookings(int *cursor, int indexes[], int maxIndexes);
+int countLiveBookings();
+int lastLiveBooking();
+int ensurePaymentCapacity(int needed);
+int claimPaymentSlot();
+uint64_t phoneKey(const char phone[]);
+PhoneSlot *findPhoneSlot(uint64_t key, int create);
+void rebuildPhoneIndex();
+void indexBookingPhone(int bookingIndex);
+void unindexBookingPhone(int bookingIndex);
+int firstBookingForPhone(const char phone[]);
+int selectBookingByPhone(char phone[]);
+void cancelBooking(int bookingIndex);
+int cancelSeat(int routeIndex, int seatNumber);
+void foldName(char folded[], const char name[]);
+unsigned int foldedNameHash(const char folded[]);
+const char *cityName(int cityID);
+int cityLowerBound(const char folded[]);
+void insertCitySlot(int cityID);
+int compareCityOrder(const void *a, const void *b);
+void rebuildCityIndex();
+int findCity(const char name[]);
+int addCity(const char name[]);
+int internCity(const char name[]);
+void loadCities(const CityRecord *records, int count);
+int findDestination(const char destination[]);
+void indexRouteDestination(int routeIndex);
+void adjustDestinationBookings(int routeIndex, int delta);
+void rebuildDestinationIndex();
+int completeDestinations(const char prefix[], int results[], int maxResults);
+uint64_t freeSeatWord(Route *route, int word);
+int isSeatBooked(Route *route, int seatNumber);
+int markSeatBooked(Route *route, int seatNumber);
+void markSeatFree(Route *route, int seatNumber);
+int bookedSeatCount(Route *route);
+int freeSeatCount(Route *route);
+int nextFreeSeat(Route *route, int fromSeat);
+int resizeSeatOwners(int routeIndex, int capacity);
+void rebuildSeatOwners();
+int seatBooking(int routeIndex, int seatNumber);
+int findBookingByDestinationSeat(char destination[], int seatNumber);
+void showRouteSeats(int routeIndex);
+void editReservation();
+void cancelReservation();
+void viewAllBookings();
+void printTicket(int seatNumber, int routeIndex);
+void adminViewPassengerDetails();
+void adminSearchByPhone();
+void adminSearchByDestination();
+void showDestinationHints(char partialDest[]);
+void adminCancelReservation();
+void adminPrintTicket();
+void adminSetBusDetails();
+void adminLogout();
+void adminViewMetrics();
+int choosePaymentMethod();
+void printPaymentSummary(int paymentID);
+int lookupOrCreateRoute(char source[], char destination[], int *created);
+int reserveSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice);
+int reserveClaimedSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice);
+void publishBooking(int bookingIndex, int routeIndex, int seatNumber, const char name[], const char phone[]);
+void recordPayment(int paymentID, int bookingIndex, int choice, int seats);
+int bookSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice);
+void shiftSeatMask(const uint64_t in[], uint64_t out[], int shift);
+int findSeatGroup(Route *route, int count, uint64_t chosen[]);
+int claimSeatGroup(Route *route, const uint64_t mask[]);
+void releaseSeatGroup(Route *route, const uint64_t mask[]);
+int reserveSeatGroup(int routeIndex, const uint64_t mask[], int count, const char name[], const char phone[],
+                     int paymentChoice, int bookingIndexes[]);
+int bookGroup(int routeIndex, int count, const char name[], const char phone[], int paymentChoice, int bookingIndexes[]);
+void bookGroupTicket();
+void printGroupTicket(const int bookingIndexes[], int count);
+uint64_t currentHoldTick();
+int ensureHoldCapacity(int needed);
+void resetHolds();
+void fileHold(int holdIndex);
+void unfileHold(int holdIndex);
+void freeHold(int holdIndex);
+void expireHolds();
+int takeHold(int64_t token, int *routeIndex, int *seatNumber);
+int64_t holdSeat(int routeIndex, int seatNumber, int seconds);
+int confirmHold(int64_t token, const char name[], const char phone[], int paymentChoice);
+int releaseHold(int64_t token);
+int updateSeatDetails(int routeIndex, int seatNumber, const char name[], const char phone[]);
+int parseDepartureTime(const char text[]);
+int setRouteDeparture(int routeIndex, int departureMinute);
+int setRouteDuration(int routeIndex, int durationMinutes);
+int setRouteCapacity(int routeIndex, int capacity);
+uint64_t nextTransactionID();
+uint64_t transactionStamp(uint64_t transactionID);
+void raiseTransactionFloor(uint64_t transactionID);
+void rebuildTransactionFloor();
+char *formatTransactionID(uint64_t transactionID, char text[]);
+int64_t calculateFee(int64_t amount, int feeBasisPoints);
+void calculateFees(const int64_t amounts[], const int feeBasisPoints[], int64_t fees[], int count);
+int settlePayments(PaymentSettlement totals[]);
+void clearInputBuffer();
+void saveUserData();
+void loadUserData();
+int ensureUserCapacity(int needed);
+int replayUserLog(const char path[], uint32_t snapshotGeneration, int *migrated);
+int migrateLegacyUser(const LegacyUser *legacy);
+void openUserLog();
+void appendUserRecord(int userIndex);
+void compactUserData();
+void *writeUserSnapshot(void *arg);
+int storeUserSnapshot(const User *snapshotUsers, int count, uint32_t generation);
+void saveRoutesData();
+void loadRoutesData();
+void rebuildIndexes();
+void *growTable(void *table, int *mapped, size_t usedBytes, size_t newBytes);
+void releaseDataFileMap();
+int writeDataSection(FILE *file, DataSection *section, int id, const void *data, size_t elementSize, int count);
+const void *mapDataSection(DataFileHeader *header, DataSection *sections, int id, size_t elementSize, uint64_t *count);
+void rejectDataFile(const char reason[]);
+void initCrc32Table();
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length);
+void openJournal();
+void replayJournal();
+void applyJournalRecord(JournalHeader *header, const void *payload);
+void journalAppend(int type, int index, const void *payload, size_t length);
+void journalCommit();
+void journalSync();
+void checkpointJournal();
+void outputPrintf(OutputBuffer *out, const char *format, ...);
+int splitFields(char line[], char *fields[], int maxFields);
+int parsePaymentChoice(const char text[]);
+void outputBookingMatch(OutputBuffer *out, int bookingIndex);
+int executeCommand(char line[], OutputBuffer *out);
+void runBatch(FILE *input);
+int openTcpListener(int port);
+int openUnixListener(const char path[]);
+void handleStopSignal(int signalNumber);
+void updateConnectionEvents(int epollFd, Connection *conn);
+void closeConnection(int epollFd, Connection *conn);
+void acceptConnections(int epollFd, Connection *listener);
+int flushConnection(Connection *conn);
+void readConnection(Connection *conn);
+void runConnectionLines(Connection *conn);
+int isAuthCommand(const char line[]);
+int queueAuth(Connection *conn, const char line[]);
+void *authWorker(void *arg);
+void finishAuth(Connection *conn);
+void *serverWorker(void *arg);
+int runServer(int port, const char socketPath[]);
+int connectToServer(const char address[]);
+int runClient(const char address[]);
+unsigned int benchPick(int iteration, int range);
+void benchFindRoute(int iteration);
+void benchFindOrCreateRoute(int iteration);
+void benchSeatAvailability(int iteration);
+void benchBookingSlot(int iteration);
+void benchBookAndCancel(int iteration);
+void benchSearchByPhone(int iteration);
+void benchSearchByDestination(int iteration);
+void benchDestinationHints(int iteration);
+void benchTicketLookup(int iteration);
+void benchTransactionID(int iteration);
+void benchSaveRoutesData(int iteration);
+void benchLoadRoutesData(int iteration);
+void runBenchmark(const char name[], void (*operation)(int), int iterations);
+int populateBenchData(int routeTotal, int bookingTotal);
+int runBenchmarks(int routeTotal, int bookingTotal, int iterations);
+int latencyBucket(uint64_t ns);
+uint64_t latencyBucketValue(int bucket);
+void recordLatency(LatencyHistogram *histogram, uint64_t ns);
+void mergeLatency(LatencyHistogram *into, const LatencyHistogram *from);
+uint64_t latencyPercentile(const LatencyHistogram *histogram, double percentile);
+uint64_t elapsedNanos(const struct timespec *from, const struct timespec *to);
+int loadPickRoute(unsigned int *seed);
+int loadPickBookedSeat(int routeIndex, unsigned int *seed);
+int loadBook(LoadWorker *worker);
+int loadCancel(LoadWorker *worker);
+int loadEdit(LoadWorker *worker);
+int loadSearch(LoadWorker *worker, OutputBuffer *out);
+void *loadWorkerMain(void *arg);
+int runLoadGenerator(int threads, int seconds, long rate, int routeTotal);
+MetricTimer startMetricTimer(int metric);
+void finishMetricTimer(MetricTimer *timer);
+MetricShard *collectMetrics();
+void outputMetricsJson(OutputBuffer *out, const MetricShard *total);
+int writeMetricsFile(const char path[]);
+int outputMetrics(OutputBuffer *out);
+int parseReportFormat(const char text[]);
+int parseReportDate(const char text[], int days, int64_t *seconds);
+int openReport(ReportWriter *report, const char path[], int format, const ReportColumn columns[], int columnCount);
+void reportFlush(ReportWriter *report);
+void reportAppend(ReportWriter *report, const void *data, size_t length);
+void reportText(ReportWriter *report, const char text[], int width);
+int formatReportNumber(char field[], int64_t number, int decimals);
+void reportValue(ReportWriter *report, const ReportColumn *column, const ReportValue *value);
+void reportBlock(ReportWriter *report);
+void reportDrain(ReportWriter *report, int batchRows);
+void reportRow(ReportWriter *report, const ReportValue values[]);
+int closeReport(ReportWriter *report);
+void reportBooking(ReportWriter *report, int bookingIndex, const ReportFilter *filter);
+void reportRoute(ReportWriter *report, int routeIndex);
+long writeReport(const char path[], int kind, int format, const ReportFilter *filter);
+const char *parseReportFilter(const char source[], const char destination[], const char from[], const char to[],
+                              ReportFilter *filter);
+int runReport(int argc, char *argv[]);
+void adminExportReport();
+
+int main(int argc, char *argv[]) {
+    if(argc > 1 && strcmp(argv[1], "--client") == 0) {
+        return runClient(argc > 2 ? argv[2] : SERVER_SOCKET_PATH);
+    }
+    
+    initializeSystem();
+    
+    if(argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return runBenchmarks(argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_ROUTES,
+                             argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_BOOKINGS,
+                             argc > 4 ? atoi(argv[4]) : BENCH_DEFAULT_ITERATIONS);
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--loadgen") == 0) {
+        return runLoadGenerator(argc > 2 ? atoi(argv[2]) : LOADGEN_DEFAULT_THREADS,
+                                argc > 3 ? atoi(argv[3]) : LOADGEN_DEFAULT_SECONDS,
+                                argc > 4 ? atol(argv[4]) : 0,
+                                argc > 5 ? atoi(argv[5]) : LOADGEN_DEFAULT_ROUTES);
+    }
+    
+    initializeUsers();
+    loadUserData();
+    loadRoutesData();
+    openJournal();
+    
+    if(argc > 1 && strcmp(argv[1], "--report") == 0) {
+        return runReport(argc, argv);
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        FILE *input = stdin;
+        if(argc > 2 && strcmp(argv[2], "-") != 0) {
+            input = fopen(argv[2], "r");
+            if(input == NULL) {
+                fprintf(stderr, "Unable to open %s\n", argv[2]);
+                return 1;
+            }
+        }
+        runBatch(input);
+        saveUserData();
+        checkpointJournal();
+        writeMetricsFile(METRICS_DUMP_PATH);
+        return 0;
+    }
+    
+    if(argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        int port = argc > 2 ? atoi(argv[2]) : SERVER_DEFAULT_PORT;
+        int status = runServer(port, argc > 3 ? argv[3] : SERVER_SOCKET_PATH);
+        saveUserData();
+        checkpointJournal();
+        writeMetricsFile(METRICS_DUMP_PATH);
+        return status;
+    }
+    
+    int choice;
+    
+    printf("=== Welcome to Transport Ticket Booking System ===\n");
+    
+    do {
+        printf("\n=== MAIN MENU ===\n");
+        printf("1. User Login\n");
+        printf("2. User Signup\n");
+        printf("3. Admin Login\n");
+        printf("4. Exit\n");
+        printf("=================\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1:
+                userLogin();
+                break;
+            case 2:
+                userSignup();
+                break;
+            case 3:
+                if(authenticateAdmin()) {
+                    adminPanel();
+                }
+                break;
+            case 4:
+                saveUserData();
+                checkpointJournal();
+                writeMetricsFile(METRICS_DUMP_PATH);
+                printf("Thank you for using our booking system. Goodbye!\n");
+                break;
+            default:
+                printf("Invalid choice! Please try again.\n");
+        }
+    } while(choice != 4);
+    
+    return 0;
+}
+
+void initializeSystem() {
+    srand(time(0));
+    
+    // Every process sharing a store or feeding one settlement run needs its
+    // own node id, or their IDs can collide.
+    const char *node = getenv("TTBS_NODE_ID");
+    if(node != NULL) {
+        transactionNode = atoi(node) & ((1 << TRANSACTION_NODE_BITS) - 1);
+    }
+    
+    for(int i = 0; i < ROUTE_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&routeLocks[i], NULL);
+        pthread_mutex_init(&timetableLocks[i], NULL);
+    }
+    
+    if(!ensureBookingCapacity(INITIAL_BOOKING_CAPACITY) ||
+       !ensurePaymentCapacity(INITIAL_PAYMENT_CAPACITY)) {
+        printf("Unable to allocate booking tables!\n");
+        exit(1);
+    }
+    
+    routeCount = 0;
+    if(!ensureRouteCapacity(INITIAL_ROUTE_CAPACITY)) {
+        printf("Unable to allocate route table!\n");
+        exit(1);
+    }
+    rebuildRouteIndex();
+    rebuildPhoneIndex();
+    resetHolds();
+    
+    bookedSeats = 0;
+    paymentCount = 0;
+}
+
+void initializeUsers() {
+    if(!ensureUserCapacity(INITIAL_USER_CAPACITY)) {
+        printf("Unable to allocate user table!\n");
+        exit(1);
+    }
+    
+    // New passwords are hashed with this many iterations; existing accounts
+    // keep the count they were created with.
+    const char *iterations = getenv("TTBS_PASSWORD_ITERATIONS");
+    if(iterations != NULL && atol(iterations) > 0) {
+        passwordIterations = (uint32_t)atol(iterations);
+    }
+    
+    if(!fillRandom(sessionKey, sizeof(sessionKey))) {
+        printf("Unable to seed the session cache!\n");
+        exit(1);
+    }
+    for(int i = 0; i < SESSION_SLOTS; i++) {
+        sessions[i].userIndex = -1;
+    }
+}
+
+pthread_mutex_t *routeLock(int routeIndex) {
+    return &routeLocks[routeIndex & (ROUTE_LOCK_STRIPES - 1)];
+}
+
+pthread_mutex_t *timetableLock(int corridor) {
+    return &timetableLocks[corridor & (ROUTE_LOCK_STRIPES - 1)];
+}
+
+void acquireStoreShared() {
+    pthread_rwlock_rdlock(&storeLock);
+}
+
+void acquireStoreExclusive() {
+    pthread_rwlock_wrlock(&storeLock);
+}
+
+// Checkpoints requested by journalCommit need the store to themselves, so
+// they run here once the caller has let go of storeLock.
+void releaseStore() {
+    pthread_rwlock_unlock(&storeLock);
+    
+    if(__atomic_load_n(&checkpointDue, __ATOMIC_ACQUIRE)) {
+        pthread_rwlock_wrlock(&storeLock);
+        if(checkpointDue) {
+            checkpointJournal();
+        }
+        pthread_rwlock_unlock(&storeLock);
+    }
+}
+
+// Trades a shared hold on storeLock for an exclusive one long enough to grow
+// a table, then takes the shared hold back. Handles stay valid across the
+// gap; pointers into the tables do not.
+int growWhileShared(int (*ensureCapacity)(int), int needed) {
+    pthread_rwlock_unlock(&storeLock);
+    pthread_rwlock_wrlock(&storeLock);
+    int ok = ensureCapacity(needed);
+    pthread_rwlock_unlock(&storeLock);
+    pthread_rwlock_rdlock(&storeLock);
+    return ok;
+}
+
+int ensureRouteCapacity(int needed) {
+    if(needed <= routeCapacity) return 1;
+    
+    int newCapacity = routeCapacity > 0 ? routeCapacity : INITIAL_ROUTE_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    int **grownOwners = realloc(seatOwners, sizeof(int *) * newCapacity);
+    if(grownOwners == NULL) return 0;
+    memset(grownOwners + routeCapacity, 0, sizeof(int *) * (newCapacity - routeCapacity));
+    seatOwners = grownOwners;
+    
+    Route *grown = growTable(routes, &routesMapped, sizeof(Route) * routeCapacity, sizeof(Route) * newCapacity);
+    if(grown == NULL) return 0;
+    
+    memset(grown + routeCapacity, 0, sizeof(Route) * (newCapacity - routeCapacity));
+    for(int i = routeCapacity; i < newCapacity; i++) {
+        grown[i].routeID = i;
+    }
+    routes = grown;
+    routeCapacity = newCapacity;
+    return 1;
+}
+
+// City ids are already case-folded identities, so the key is just the pair.
+unsigned int routeKeyHash(int sourceCity, int destinationCity) {
+    uint64_t key = (uint64_t)(uint32_t)sourceCity << 32 | (uint32_t)destinationCity;
+    return (unsigned int)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+int routeSlotMatches(RouteSlot *slot, unsigned int hash, int sourceCity, int destinationCity) {
+    return slot->hash == hash &&
+           corridors[slot->corridor].sourceCity == sourceCity &&
+           corridors[slot->corridor].destinationCity == destinationCity;
+}
+
+void insertRouteSlot(int corridor) {
+    unsigned int hash = routeKeyHash(corridors[corridor].sourceCity, corridors[corridor].destinationCity);
+    int mask = routeSlotCount - 1;
+    int pos = hash & mask;
+    
+    while(routeSlots[pos].corridor != -1) {
+        pos = (pos + 1) & mask;
+    }
+    routeSlots[pos].hash = hash;
+    routeSlots[pos].corridor = corridor;
+}
+
+void rebuildRouteSlots() {
+    int slotCount = 16;
+    while(slotCount < corridorCount * 2) {
+        slotCount *= 2;
+    }
+    
+    RouteSlot *slots = malloc(sizeof(RouteSlot) * slotCount);
+    if(slots == NULL) {
+        printf("Unable to allocate route index!\n");
+        exit(1);
+    }
+    for(int i = 0; i < slotCount; i++) {
+        slots[i].hash = 0;
+        slots[i].corridor = -1;
+    }
+    
+    free(routeSlots);
+    routeSlots = slots;
+    routeSlotCount = slotCount;
+    
+    for(int i = 0; i < corridorCount; i++) {
+        insertRouteSlot(i);
+    }
+}
+
+int addCorridor(int sourceCity, int destinationCity) {
+    if(corridorCount == corridorCapacity) {
+        int newCapacity = corridorCapacity > 0 ? corridorCapacity * 2 : 64;
+        Corridor *grown = realloc(corridors, sizeof(Corridor) * newCapacity);
+        if(grown == NULL) return -1;
+        corridors = grown;
+        corridorCapacity = newCapacity;
+    }
+    
+    int corridor = corridorCount++;
+    memset(&corridors[corridor], 0, sizeof(Corridor));
+    corridors[corridor].sourceCity = sourceCity;
+    corridors[corridor].destinationCity = destinationCity;
+    corridors[corridor].firstRoute = -1;
+    
+    if(corridorCount * 2 > routeSlotCount) {
+        rebuildRouteSlots();
+    } else {
+        insertRouteSlot(corridor);
+    }
+    return corridor;
+}
+
+// Appends the route unsorted; the caller sorts the corridor afterwards. The
+// lowest route index stays the one lookups by city pair return.
+int addCorridorDeparture(int corridor, int routeIndex) {
+    Corridor *entry = &corridors[corridor];
+    if(entry->departureCount == entry->departureCapacity) {
+        int newCapacity = entry->departureCapacity > 0 ? entry->departureCapacity * 2 : 4;
+        int *grown = realloc(entry->departures, sizeof(int) * newCapacity);
+        if(grown == NULL) return 0;
+        entry->departures = grown;
+        entry->departureCapacity = newCapacity;
+    }
+    
+    entry->departures[entry->departureCount++] = routeIndex;
+    if(entry->firstRoute == -1 || routeIndex < entry->firstRoute) {
+        entry->firstRoute = routeIndex;
+    }
+    routeCorridors[routeIndex] = corridor;
+    return 1;
+}
+
+// routeCorridors and departureSlots map a route to its corridor and to its
+// position in that corridor's departures.
+int ensureDepartureIndexCapacity(int needed) {
+    if(needed <= departureIndexCapacity) return 1;
+    
+    int newCapacity = departureIndexCapacity > 0 ? departureIndexCapacity : INITIAL_ROUTE_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    int *grownCorridors = realloc(routeCorridors, sizeof(int) * newCapacity);
+    if(grownCorridors == NULL) return 0;
+    routeCorridors = grownCorridors;
+    int *grownSlots = realloc(departureSlots, sizeof(int) * newCapacity);
+    if(grownSlots == NULL) return 0;
+    departureSlots = grownSlots;
+    
+    for(int i = departureIndexCapacity; i < newCapacity; i++) {
+        routeCorridors[i] = -1;
+        departureSlots[i] = -1;
+    }
+    departureIndexCapacity = newCapacity;
+    return 1;
+}
+
+int compareDepartures(const void *a, const void *b) {
+    int left = *(const int *)a;
+    int right = *(const int *)b;
+    if(routes[left].departureMinute != routes[right].departureMinute) {
+        return routes[left].departureMinute - routes[right].departureMinute;
+    }
+    return left - right;
+}
+
+// Re-sorts a corridor and rebuilds its seat tree from the seat maps. Needs
+// storeLock exclusively (or a single thread), since the tree may move.
+void sortDepartures(int corridor) {
+    Corridor *entry = &corridors[corridor];
+    qsort(entry->departures, entry->departureCount, sizeof(int), compareDepartures);
+    
+    int leafCount = 1;
+    while(leafCount < entry->departureCount) {
+        leafCount *= 2;
+    }
+    if(entry->freeSeats == NULL || leafCount != entry->leafCount) {
+        int *tree = realloc(entry->freeSeats, sizeof(int) * leafCount * 2);
+        if(tree == NULL) {
+            printf("Unable to allocate timetable!\n");
+            exit(1);
+        }
+        entry->freeSeats = tree;
+        entry->leafCount = leafCount;
+    }
+    
+    for(int i = 0; i < leafCount; i++) {
+        int value = -1;
+        if(i < entry->departureCount) {
+            departureSlots[entry->departures[i]] = i;
+            value = freeSeatCount(&routes[entry->departures[i]]);
+        }
+        entry->freeSeats[leafCount + i] = value;
+    }
+    for(int node = leafCount - 1; node >= 1; node--) {
+        int left = entry->freeSeats[node * 2];
+        int right = entry->freeSeats[node * 2 + 1];
+        entry->freeSeats[node] = left > right ? left : right;
+    }
+}
+
+// Called after seats on a route are claimed or released. The leaf is re-read
+// from the seat map under the timetable lock, so racing updates settle on the
+// latest count. Caller holds storeLock shared.
+void refreshDeparture(int routeIndex) {
+    int corridor = routeIndex < departureIndexCapacity ? routeCorridors[routeIndex] : -1;
+    if(corridor == -1) return;
+    
+    pthread_mutex_lock(timetableLock(corridor));
+    Corridor *entry = &corridors[corridor];
+    int node = entry->leafCount + departureSlots[routeIndex];
+    entry->freeSeats[node] = freeSeatCount(&routes[routeIndex]);
+    for(node /= 2; node >= 1; node /= 2) {
+        int left = entry->freeSeats[node * 2];
+        int right = entry->freeSeats[node * 2 + 1];
+        entry->freeSeats[node] = left > right ? left : right;
+    }
+    pthread_mutex_unlock(timetableLock(corridor));
+}
+
+// Leftmost leaf at or after from holding at least seats, within the node
+// spanning [low, high); -1 if there is none.
+int firstDepartureWithSeats(const Corridor *corridor, int node, int low, int high, int from, int seats) {
+    if(high <= from || corridor->freeSeats[node] < seats) return -1;
+    if(high - low == 1) return low;
+    
+    int mid = (low + high) / 2;
+    int found = firstDepartureWithSeats(corridor, node * 2, low, mid, from, seats);
+    return found != -1 ? found : firstDepartureWithSeats(corridor, node * 2 + 1, mid, high, from, seats);
+}
+
+// Returns the route of the first departure at or after minute with at least
+// seats free, or -1. Caller holds storeLock shared.
+int nextDeparture(int corridor, int minute, int seats) {
+    if(corridor < 0 || corridor >= corridorCount) return -1;
+    
+    Corridor *entry = &corridors[corridor];
+    int low = 0;
+    int high = entry->departureCount;
+    while(low < high) {
+        int mid = (low + high) / 2;
+        if(routes[entry->departures[mid]].departureMinute < minute) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    pthread_mutex_lock(timetableLock(corridor));
+    int slot = firstDepartureWithSeats(entry, 1, 0, entry->leafCount, low, seats > 0 ? seats : 0);
+    pthread_mutex_unlock(timetableLock(corridor));
+    return slot == -1 || slot >= entry->departureCount ? -1 : entry->departures[slot];
+}
+
+int compareConnections(const void *a, const void *b) {
+    const TimetableConnection *left = a;
+    const TimetableConnection *right = b;
+    if(left->departure != right->departure) return left->departure - right->departure;
+    return left->routeIndex - right->routeIndex;
+}
+
+int ensureConnectionCapacity(int needed) {
+    if(needed <= timetableConnectionCapacity) return 1;
+    
+    int newCapacity = timetableConnectionCapacity > 0 ? timetableConnectionCapacity : INITIAL_ROUTE_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    int *grownSlots = realloc(connectionSlots, sizeof(int) * newCapacity);
+    if(grownSlots == NULL) return 0;
+    for(int i = timetableConnectionCapacity; i < newCapacity; i++) {
+        grownSlots[i] = -1;
+    }
+    connectionSlots = grownSlots;
+    
+    TimetableConnection *grown = realloc(timetableConnections, sizeof(TimetableConnection) * newCapacity);
+    if(grown == NULL) return 0;
+    timetableConnections = grown;
+    timetableConnectionCapacity = newCapacity;
+    return 1;
+}
+
+// Rebuilds the planner's connection list, and connectionSlots, which maps
+// each route to its position in it, from routes[]; runs after a load.
+void rebuildConnections() {
+    if(!ensureConnectionCapacity(routeCount > 0 ? routeCount : 1)) {
+        printf("Unable to allocate timetable!\n");
+        exit(1);
+    }
+    
+    timetableConnectionCount = 0;
+    for(int i = 0; i < routeCount; i++) {
+        if(!routes[i].isActive) continue;
+        TimetableConnection *connection = &timetableConnections[timetableConnectionCount++];
+        connection->departure = routes[i].departureMinute;
+        connection->arrival = routes[i].departureMinute + routes[i].durationMinutes;
+        connection->sourceCity = routes[i].sourceCity;
+        connection->destinationCity = routes[i].destinationCity;
+        connection->routeIndex = i;
+    }
+    qsort(timetableConnections, timetableConnectionCount, sizeof(TimetableConnection), compareConnections);
+    
+    for(int i = 0; i < routeCount; i++) {
+        connectionSlots[i] = -1;
+    }
+    for(int i = 0; i < timetableConnectionCount; i++) {
+        connectionSlots[timetableConnections[i].routeIndex] = i;
+    }
+}
+
+// Files a new route into the sorted connection list. Caller holds storeLock
+// exclusively.
+int insertConnection(int routeIndex) {
+    int needed = timetableConnectionCount > routeIndex ? timetableConnectionCount + 1 : routeIndex + 1;
+    if(!ensureConnectionCapacity(needed)) return 0;
+    
+    TimetableConnection *connection = &timetableConnections[timetableConnectionCount++];
+    connection->departure = routes[routeIndex].departureMinute;
+    connection->arrival = routes[routeIndex].departureMinute + routes[routeIndex].durationMinutes;
+    connection->sourceCity = routes[routeIndex].sourceCity;
+    connection->destinationCity = routes[routeIndex].destinationCity;
+    connection->routeIndex = routeIndex;
+    repositionConnection(timetableConnectionCount - 1);
+    return 1;
+}
+
+// Slides the connection at position to its sorted place after it was added
+// or its departure moved, updating connectionSlots for every entry it
+// passes. Caller holds storeLock exclusively.
+void repositionConnection(int position) {
+    TimetableConnection moved = timetableConnections[position];
+    
+    while(position > 0 && compareConnections(&timetableConnections[position - 1], &moved) > 0) {
+        timetableConnections[position] = timetableConnections[position - 1];
+        connectionSlots[timetableConnections[position].routeIndex] = position;
+        position--;
+    }
+    while(position + 1 < timetableConnectionCount &&
+          compareConnections(&timetableConnections[position + 1], &moved) < 0) {
+        timetableConnections[position] = timetableConnections[position + 1];
+        connectionSlots[timetableConnections[position].routeIndex] = position;
+        position++;
+    }
+    timetableConnections[position] = moved;
+    connectionSlots[moved.routeIndex] = position;
+}
+
+// Connection scan over today's and tomorrow's buses, keeping for each leg
+// count k the earliest arrival at every city using exactly k legs. A bus is
+// boarded only if it has seats free and, after the first leg, leaves at least
+// TRANSFER_MINUTES after the passenger gets in. Earliest-arrival mode takes
+// the best arrival over all leg counts; fewest-transfers mode the smallest
+// leg count that arrives at all. Fills legs and returns the arrival minute,
+// or -1. Caller holds storeLock shared.
+int planJourney(int sourceCity, int destinationCity, int minute, int seats, int mode,
+                JourneyLeg legs[], int *legCount) {
+    *legCount = 0;
+    if(sourceCity == destinationCity || sourceCity < 0 || destinationCity < 0) return -1;
+    
+    size_t cells = (size_t)(MAX_JOURNEY_LEGS + 1) * cityCount;
+    int *arrival = malloc(sizeof(int) * cells * 2);
+    if(arrival == NULL) return -1;
+    int *via = arrival + cells;
+    for(size_t i = 0; i < cells; i++) {
+        arrival[i] = INT_MAX;
+        via[i] = -1;
+    }
+    arrival[sourceCity] = minute;
+    
+    int best = INT_MAX;
+    int first = 0;
+    while(first < timetableConnectionCount && timetableConnections[first].departure < minute) {
+        first++;
+    }
+    
+    for(int day = 0; day < 2; day++) {
+        for(int i = day == 0 ? first : 0; i < timetableConnectionCount; i++) {
+            const TimetableConnection *connection = &timetableConnections[i];
+            int departure = connection->departure + day * MINUTES_PER_DAY;
+            if(departure >= best) goto scanned;
+            
+            int arrive = connection->arrival + day * MINUTES_PER_DAY;
+            int checked = 0;
+            for(int k = 1; k <= MAX_JOURNEY_LEGS; k++) {
+                int ready = arrival[(size_t)(k - 1) * cityCount + connection->sourceCity];
+                if(ready == INT_MAX) continue;
+                if(k > 1) ready += TRANSFER_MINUTES;
+                
+                size_t cell = (size_t)k * cityCount + connection->destinationCity;
+                if(ready > departure || arrive >= arrival[cell]) continue;
+                if(!checked) {
+                    if(freeSeatCount(&routes[connection->routeIndex]) < seats) break;
+                    checked = 1;
+                }
+                arrival[cell] = arrive;
+                via[cell] = day * timetableConnectionCount + i;
+                
+                if(connection->destinationCity == destinationCity &&
+                   (mode == JOURNEY_EARLIEST_ARRIVAL || k == 1) && arrive < best) {
+                    best = arrive;
+                }
+            }
+        }
+    }
+    scanned:;
+    
+    int chosen = -1;
+    for(int k = 1; k <= MAX_JOURNEY_LEGS; k++) {
+        int at = arrival[(size_t)k * cityCount + destinationCity];
+        if(at == INT_MAX) continue;
+        if(chosen == -1 || (mode == JOURNEY_EARLIEST_ARRIVAL &&
+                            at < arrival[(size_t)chosen * cityCount + destinationCity])) {
+            chosen = k;
+        }
+        if(mode == JOURNEY_FEWEST_TRANSFERS) break;
+    }
+    
+    int result = -1;
+    if(chosen != -1) {
+        result = arrival[(size_t)chosen * cityCount + destinationCity];
+        int city = destinationCity;
+        for(int k = chosen; k >= 1; k--) {
+            int step = via[(size_t)k * cityCount + city];
+            int day = step / timetableConnectionCount;
+            const TimetableConnection *connection = &timetableConnections[step % timetableConnectionCount];
+            legs[k - 1].routeIndex = connection->routeIndex;
+            legs[k - 1].departure = connection->departure + day * MINUTES_PER_DAY;
+            legs[k - 1].arrival = connection->arrival + day * MINUTES_PER_DAY;
+            city = connection->sourceCity;
+        }
+        *legCount = chosen;
+    }
+    
+    free(arrival);
+    return result;
+}
+
+void rebuildRouteIndex() {
+    for(int i = 0; i < corridorCount; i++) {
+        free(corridors[i].departures);
+        free(corridors[i].freeSeats);
+    }
+    corridorCount = 0;
+    rebuildRouteSlots();
+    
+    if(!ensureDepartureIndexCapacity(routeCount > 0 ? routeCount : 1)) {
+        printf("Unable to allocate route index!\n");
+        exit(1);
+    }
+    for(int i = 0; i < departureIndexCapacity; i++) {
+        routeCorridors[i] = -1;
+        departureSlots[i] = -1;
+    }
+    
+    for(int i = 0; i < routeCount; i++) {
+        int corridor = findCorridor(routes[i].sourceCity, routes[i].destinationCity);
+        if(corridor == -1) {
+            corridor = addCorridor(routes[i].sourceCity, routes[i].destinationCity);
+        }
+        if(corridor == -1 || !addCorridorDeparture(corridor, i)) {
+            printf("Unable to allocate route index!\n");
+            exit(1);
+        }
+    }
+    for(int i = 0; i < corridorCount; i++) {
+        sortDepartures(i);
+    }
+}
+
+// Files a new route under its corridor. Caller holds storeLock exclusively.
+int indexRoute(int routeIndex) {
+    int corridor = findCorridor(routes[routeIndex].sourceCity, routes[routeIndex].destinationCity);
+    if(corridor == -1) {
+        corridor = addCorridor(routes[routeIndex].sourceCity, routes[routeIndex].destinationCity);
+    }
+    if(corridor == -1 || !ensureDepartureIndexCapacity(routeIndex + 1) ||
+       !addCorridorDeparture(corridor, routeIndex)) {
+        return 0;
+    }
+    sortDepartures(corridor);
+    return 1;
+}
+
+int findRoute(char source[], char destination[]) {
+    int sourceCity = findCity(source);
+    int destinationCity = findCity(destination);
+    if(sourceCity == -1 || destinationCity == -1) return -1;
+    return findRouteByCities(sourceCity, destinationCity);
+}
+
+int findRouteByCities(int sourceCity, int destinationCity) {
+    int corridor = findCorridor(sourceCity, destinationCity);
+    return corridor != -1 ? corridors[corridor].firstRoute : -1;
+}
+
+int findCorridor(int sourceCity, int destinationCity) {
+    if(routeSlotCount == 0) return -1;
+    
+    unsigned int hash = routeKeyHash(sourceCity, destinationCity);
+    int mask = routeSlotCount - 1;
+    int pos = hash & mask;
+    
+    while(routeSlots[pos].corridor != -1) {
+        if(routeSlotMatches(&routeSlots[pos], hash, sourceCity, destinationCity)) {
+            return routeSlots[pos].corridor;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+int createRoute(char source[], char destination[], int departureMinute, int durationMinutes, int capacity) {
+    if(!ensureRouteCapacity(routeCount + 1)) {
+        printf("Unable to allocate more routes!\n");
+        return -1;
+    }
+    
+    // New cities are journaled ahead of the route that refers to them.
+    int knownCities = cityCount;
+    int sourceCity = internCity(source);
+    int destinationCity = internCity(destination);
+    for(int id = knownCities; id < cityCount; id++) {
+        journalAppend(JOURNAL_CITY, id, cities[id].name, sizeof(CityRecord));
+    }
+    if(sourceCity == -1 || destinationCity == -1) {
+        printf("Unable to allocate more cities!\n");
+        return -1;
+    }
+    
+    int routeIndex = routeCount;
+    routes[routeIndex].routeID = routeCount;
+    routes[routeIndex].sourceCity = sourceCity;
+    routes[routeIndex].destinationCity = destinationCity;
+    routes[routeIndex].departureMinute = departureMinute;
+    routes[routeIndex].durationMinutes = durationMinutes;
+    
+    routes[routeIndex].capacity = capacity;
+    routes[routeIndex].isActive = 1;
+    
+    for(int i = 0; i < SEAT_WORDS; i++) {
+        routes[routeIndex].seatMap[i] = 0;
+    }
+    
+    if(!resizeSeatOwners(routeIndex, capacity)) {
+        printf("Unable to allocate seats for route!\n");
+        return -1;
+    }
+    
+    if(!indexRoute(routeIndex) || !insertConnection(routeIndex)) {
+        printf("Unable to allocate route index!\n");
+        return -1;
+    }
+    routeCount++;
+    indexRouteDestination(routeIndex);
+    
+    journalAppend(JOURNAL_ROUTE, routeIndex, &routes[routeIndex], sizeof(Route));
+    journalCommit();
+    return routeIndex;
+}
+
+// Growth links the new slots onto the free list lowest-first, so handles stay
+// plain indexes into bookings[] and allocation never has to scan.
+int ensureBookingCapacity(int needed) {
+    if(needed <= bookingCapacity) return 1;
+    
+    int newCapacity = bookingCapacity > 0 ? bookingCapacity : INITIAL_BOOKING_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    if(!resizeBookingColumns(newCapacity)) return 0;
+    Booking *grown = growTable(bookings, &bookingsMapped, sizeof(Booking) * bookingCapacity, sizeof(Booking) * newCapacity);
+    if(grown == NULL) return 0;
+    
+    for(int i = newCapacity - 1; i >= bookingCapacity; i--) {
+        memset(&grown[i], 0, sizeof(Booking));
+        grown[i].routeID = -1;
+        grown[i].paymentID = -1;
+        grown[i].nextFree = freeBookingHead;
+        freeBookingHead = i;
+    }
+    bookings = grown;
+    bookingCapacity = newCapacity;
+    return 1;
+}
+
+// Returns -1 once the pool is empty; growing it needs storeLock exclusively.
+int allocateBooking() {
+    pthread_mutex_lock(&bookingPoolLock);
+    int bookingIndex = freeBookingHead;
+    if(bookingIndex != -1) {
+        freeBookingHead = bookings[bookingIndex].nextFree;
+        bookings[bookingIndex].nextFree = -1;
+    }
+    pthread_mutex_unlock(&bookingPoolLock);
+    return bookingIndex;
+}
+
+void releaseBooking(int bookingIndex) {
+    pthread_mutex_lock(&bookingPoolLock);
+    bookings[bookingIndex].isBooked = 0;
+    bookings[bookingIndex].nextFree = freeBookingHead;
+    freeBookingHead = bookingIndex;
+    pthread_mutex_unlock(&bookingPoolLock);
+}
+
+void rebuildBookingFreeList() {
+    freeBookingHead = -1;
+    for(int i = bookingCapacity - 1; i >= 0; i--) {
+        if(!bookings[i].isBooked) {
+            bookings[i].nextFree = freeBookingHead;
+            freeBookingHead = i;
+        }
+    }
+}
+
+int resizeBookingColumns(int capacity) {
+    int words = (capacity + 63) / 64;
+    int oldWords = (bookingColumnCapacity + 63) / 64;
+    
+    uint64_t *live = realloc(bookingLive, sizeof(uint64_t) * (words > 0 ? words : 1));
+    if(live == NULL) return 0;
+    bookingLive = live;
+    int *routeColumn = realloc(bookingRoutes, sizeof(int) * (capacity > 0 ? capacity : 1));
+    if(routeColumn == NULL) return 0;
+    bookingRoutes = routeColumn;
+    int *paymentColumn = realloc(bookingPayments, sizeof(int) * (capacity > 0 ? capacity : 1));
+    if(paymentColumn == NULL) return 0;
+    bookingPayments = paymentColumn;
+    
+    if(words > oldWords) {
+        memset(&bookingLive[oldWords], 0, sizeof(uint64_t) * (words - oldWords));
+    }
+    for(int i = bookingColumnCapacity; i < capacity; i++) {
+        bookingRoutes[i] = -1;
+        bookingPayments[i] = -1;
+    }
+    bookingColumnCapacity = capacity;
+    return 1;
+}
+
+// Caller holds phoneIndexLock (or is single-threaded).
+void setBookingLive(int bookingIndex, int live) {
+    uint64_t bit = UINT64_C(1) << (bookingIndex % 64);
+    
+    bookings[bookingIndex].isBooked = live;
+    bookingRoutes[bookingIndex] = bookings[bookingIndex].routeID;
+    bookingPayments[bookingIndex] = bookings[bookingIndex].paymentID;
+    if(live) {
+        bookingLive[bookingIndex / 64] |= bit;
+    } else {
+        bookingLive[bookingIndex / 64] &= ~bit;
+    }
+}
+
+void rebuildBookingColumns() {
+    if(!resizeBookingColumns(bookingCapacity)) {
+        printf("Unable to allocate booking columns!\n");
+        exit(1);
+    }
+    memset(bookingLive, 0, sizeof(uint64_t) * ((bookingCapacity + 63) / 64));
+    
+    for(int i = 0; i < bookingCapacity; i++) {
+        if(bookings[i].isBooked) {
+            setBookingLive(i, 1);
+        } else {
+            bookingRoutes[i] = -1;
+            bookingPayments[i] = -1;
+        }
+    }
+}
+
+// Copies up to maxIndexes live booking handles, from *cursor on, into
+// indexes and moves *cursor past them; returns 0 once the scan is done.
+// Runs of empty occupancy words are skipped 128 bits at a time.
+int scanBookings(int *cursor, int indexes[], int maxIndexes) {
+    int words = (bookingColumnCapacity + 63) / 64;
+    int word = *cursor / 64;
+    if(word >= words) return 0;
+    
+    int found = 0;
+    uint64_t live = bookingLive[word] & (~UINT64_C(0) << (*cursor % 64));
+    while(1) {
+        while(live != 0) {
+            int bookingIndex = word * 64 + __builtin_ctzll(live);
+            if(found == maxIndexes) {
+                *cursor = bookingIndex;
+                return found;
+            }
+            indexes[found++] = bookingIndex;
+            live &= live - 1;
+        }
+        
+        word++;
+#ifdef __SSE2__
+        while(word + 2 <= words) {
+            __m128i pair = _mm_loadu_si128((const __m128i *)&bookingLive[word]);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(pair, _mm_setzero_si128())) != 0xFFFF) break;
+            word += 2;
+        }
+#endif
+        if(word >= words) {
+            *cursor = words * 64;
+            return found;
+        }
+        live = bookingLive[word];
+    }
+}
+
+int countLiveBookings() {
+    int count = 0;
+    for(int word = 0; word < (bookingColumnCapacity + 63) / 64; word++) {
+        count += __builtin_popcountll(bookingLive[word]);
+    }
+    return count;
+}
+
+// Highest live booking handle, or -1 when nothing is booked.
+int lastLiveBooking() {
+    for(int word = (bookingColumnCapacity + 63) / 64 - 1; word >= 0; word--) {
+        if(bookingLive[word] != 0) {
+            return word * 64 + 63 - __builtin_clzll(bookingLive[word]);
+        }
+    }
+    return -1;
+}
+
+int ensurePaymentCapacity(int needed) {
+    if(needed <= paymentCapacity) return 1;
+    
+    int newCapacity = paymentCapacity > 0 ? paymentCapacity : INITIAL_PAYMENT_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    Payment *grown = growTable(payments, &paymentsMapped, sizeof(Payment) * paymentCapacity, sizeof(Payment) * newCapacity);
+    if(grown == NULL) return 0;
+    
+    payments = grown;
+    paymentCapacity = newCapacity;
+    return 1;
+}
+
+// Hands out the next payment ID, or -1 when the table has to grow first.
+int claimPaymentSlot() {
+    int slot = __atomic_load_n(&paymentCount, __ATOMIC_RELAXED);
+    do {
+        if(slot >= paymentCapacity) return -1;
+    } while(!__atomic_compare_exchange_n(&paymentCount, &slot, slot + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return slot;
+}
+
+// Phones are keyed by their digits only, so "0171-234" and "0171234" match.
+// The digit count is folded in to keep leading zeros significant, and the +1
+// keeps every real key non-zero so 0 can mark an empty slot.
+uint64_t phoneKey(const char phone[]) {
+    uint64_t value = 0;
+    int digits = 0;
+    
+    for(const char *p = phone; *p; p++) {
+        if(isdigit((unsigned char)*p) && digits < PHONE_LENGTH) {
+            value = value * 10 + (uint64_t)(*p - '0');
+            digits++;
+        }
+    }
+    return value * 16 + (uint64_t)digits + 1;
+}
+
+PhoneSlot *findPhoneSlot(uint64_t key, int create) {
+    if(phoneSlotCount == 0) return NULL;
+    
+    int mask = phoneSlotCount - 1;
+    int pos = (int)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & mask;
+    
+    while(phoneSlots[pos].key != 0) {
+        if(phoneSlots[pos].key == key) {
+            return &phoneSlots[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    
+    if(!create) return NULL;
+    
+    phoneSlots[pos].key = key;
+    phoneSlots[pos].head = -1;
+    phoneSlots[pos].tail = -1;
+    phoneSlotsUsed++;
+    return &phoneSlots[pos];
+}
+
+// Slots whose phone no longer has bookings are dropped here rather than on cancel.
+void rebuildPhoneIndex() {
+    int liveBookings = countLiveBookings();
+    int slotCount = 64;
+    while(slotCount < liveBookings * 4) {
+        slotCount *= 2;
+    }
+    
+    PhoneSlot *slots = calloc(slotCount, sizeof(PhoneSlot));
+    if(slots == NULL) {
+        printf("Unable to allocate phone index!\n");
+        exit(1);
+    }
+    
+    free(phoneSlots);
+    phoneSlots = slots;
+    phoneSlotCount = slotCount;
+    phoneSlotsUsed = 0;
+    
+    for(int i = 0; i < bookingCapacity; i++) {
+        bookings[i].prevSamePhone = -1;
+        bookings[i].nextSamePhone = -1;
+        if(bookings[i].isBooked) {
+            indexBookingPhone(i);
+        }
+    }
+}
+
+void indexBookingPhone(int bookingIndex) {
+    if((phoneSlotsUsed + 1) * 2 > phoneSlotCount) {
+        rebuildPhoneIndex();
+        if(bookings[bookingIndex].isBooked) return;
+    }
+    
+    PhoneSlot *slot = findPhoneSlot(phoneKey(bookings[bookingIndex].phone), 1);
+    bookings[bookingIndex].prevSamePhone = slot->tail;
+    bookings[bookingIndex].nextSamePhone = -1;
+    
+    if(slot->tail != -1) {
+        bookings[slot->tail].nextSamePhone = bookingIndex;
+    } else {
+        slot->head = bookingIndex;
+    }
+    slot->tail = bookingIndex;
+}
+
+void unindexBookingPhone(int bookingIndex) {
+    PhoneSlot *slot = findPhoneSlot(phoneKey(bookings[bookingIndex].phone), 0);
+    if(slot == NULL) return;
+    
+    int prev = bookings[bookingIndex].prevSamePhone;
+    int next = bookings[bookingIndex].nextSamePhone;
+    
+    if(prev != -1) {
+        bookings[prev].nextSamePhone = next;
+    } else {
+        slot->head = next;
+    }
+    if(next != -1) {
+        bookings[next].prevSamePhone = prev;
+    } else {
+        slot->tail = prev;
+    }
+    
+    bookings[bookingIndex].prevSamePhone = -1;
+    bookings[bookingIndex].nextSamePhone = -1;
+}
+
+int firstBookingForPhone(const char phone[]) {
+    PhoneSlot *slot = findPhoneSlot(phoneKey(phone), 0);
+    return slot != NULL ? slot->head : -1;
+}
+
+int selectBookingByPhone(char phone[]) {
+    int first = firstBookingForPhone(phone);
+    if(first == -1 || bookings[first].nextSamePhone == -1) {
+        return first;
+    }
+    
+    printf("\nBookings for %s:\n", phone);
+    int count = 0;
+    for(int i = first; i != -1; i = bookings[i].nextSamePhone) {
+        int routeIndex = bookings[i].routeID;
+        count++;
+        printf("%d. Seat %02d | %s | %s to %s | " DEPARTURE_FORMAT "\n", count, bookings[i].seatNo, bookings[i].name,
+               cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity),
+               DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+    }
+    
+    int choice;
+    printf("Select booking (1-%d): ", count);
+    scanf("%d", &choice);
+    clearInputBuffer();
+    
+    if(choice < 1 || choice > count) {
+        printf("Invalid selection!\n");
+        return -2;
+    }
+    
+    int bookingIndex = first;
+    while(--choice > 0) {
+        bookingIndex = bookings[bookingIndex].nextSamePhone;
+    }
+    return bookingIndex;
+}
+
+// Caller holds storeLock shared and the booking's route lock. The cancel is
+// journaled before the seat or the slot is released, so whoever reuses them
+// next is guaranteed to land later in the journal.
+void cancelBooking(int bookingIndex) {
+    int routeIndex = bookings[bookingIndex].routeID;
+    int seatNumber = bookings[bookingIndex].seatNo;
+    
+    journalAppend(JOURNAL_CANCEL, bookingIndex, NULL, 0);
+    
+    pthread_mutex_lock(&phoneIndexLock);
+    unindexBookingPhone(bookingIndex);
+    setBookingLive(bookingIndex, 0);
+    pthread_mutex_unlock(&phoneIndexLock);
+    
+    if(routeIndex != -1) {
+        __atomic_store_n(&seatOwners[routeIndex][seatNumber - 1], -1, __ATOMIC_RELEASE);
+        adjustDestinationBookings(routeIndex, -1);
+        markSeatFree(&routes[routeIndex], seatNumber);
+        refreshDeparture(routeIndex);
+    }
+    __atomic_sub_fetch(&bookedSeats, 1, __ATOMIC_RELAXED);
+    releaseBooking(bookingIndex);
+}
+
+// Returns the canceled booking handle, or -1 if the seat was not booked.
+int cancelSeat(int routeIndex, int seatNumber) {
+    METRIC_SCOPE(METRIC_CANCEL);
+    acquireStoreShared();
+    
+    int bookingIndex = -1;
+    if(routeIndex >= 0 && routeIndex < routeCount) {
+        pthread_mutex_lock(routeLock(routeIndex));
+        bookingIndex = seatBooking(routeIndex, seatNumber);
+        if(bookingIndex != -1) {
+            cancelBooking(bookingIndex);
+        }
+        pthread_mutex_unlock(routeLock(routeIndex));
+    }
+    
+    if(bookingIndex != -1) {
+        journalCommit();
+    } else {
+        METRIC_FAILED();
+    }
+    releaseStore();
+    return bookingIndex;
+}
+
+void foldName(char folded[], const char name[]) {
+    int i = 0;
+    for(; name[i] && i < CITY_LENGTH - 1; i++) {
+        folded[i] = (char)tolower((unsigned char)name[i]);
+    }
+    folded[i] = 0;
+}
+
+// FNV-1a over a name; keys both the city index and the user index.
+unsigned int foldedNameHash(const char folded[]) {
+    unsigned int hash = 2166136261u;
+    for(const char *p = folded; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+const char *cityName(int cityID) {
+    return cityID >= 0 && cityID < cityCount ? cities[cityID].name : "?";
+}
+
+// cityOrder keeps city ids sorted by folded name; ids themselves never move,
+// so routes, counters and the data file can refer to them while new names
+// are inserted into the order.
+int cityLowerBound(const char folded[]) {
+    int low = 0;
+    int high = cityCount;
+    while(low < high) {
+        int mid = (low + high) / 2;
+        if(strcmp(cities[cityOrder[mid]].folded, folded) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void insertCitySlot(int cityID) {
+    int mask = citySlotCount - 1;
+    int pos = cities[cityID].hash & mask;
+    while(citySlots[pos] != -1) {
+        pos = (pos + 1) & mask;
+    }
+    citySlots[pos] = cityID;
+}
+
+int compareCityOrder(const void *a, const void *b) {
+    return strcmp(cities[*(const int *)a].folded, cities[*(const int *)b].folded);
+}
+
+// Rebuilds the sorted order and the name hash from cities[] after a load.
+void rebuildCityIndex() {
+    int slotCount = 64;
+    while(slotCount < cityCount * 2) {
+        slotCount *= 2;
+    }
+    
+    int *slots = malloc(sizeof(int) * slotCount);
+    if(slots == NULL) {
+        printf("Unable to allocate city index!\n");
+        exit(1);
+    }
+    for(int i = 0; i < slotCount; i++) {
+        slots[i] = -1;
+    }
+    free(citySlots);
+    citySlots = slots;
+    citySlotCount = slotCount;
+    
+    for(int i = 0; i < cityCount; i++) {
+        cityOrder[i] = i;
+        insertCitySlot(i);
+    }
+    qsort(cityOrder, cityCount, sizeof(int), compareCityOrder);
+}
+
+int findCity(const char name[]) {
+    if(citySlotCount == 0) return -1;
+    
+    char folded[CITY_LENGTH];
+    foldName(folded, name);
+    unsigned int hash = foldedNameHash(folded);
+    
+    int mask = citySlotCount - 1;
+    for(int pos = hash & mask; citySlots[pos] != -1; pos = (pos + 1) & mask) {
+        City *city = &cities[citySlots[pos]];
+        if(city->hash == hash && strcmp(city->folded, folded) == 0) {
+            return citySlots[pos];
+        }
+    }
+    return -1;
+}
+
+// Appends a city without checking for an existing one; ids are handed out in
+// order so a replayed journal recreates the same ids.
+int addCity(const char name[]) {
+    if(cityCount == cityCapacity) {
+        int newCapacity = cityCapacity > 0 ? cityCapacity * 2 : 64;
+        City *grown = realloc(cities, sizeof(City) * newCapacity);
+        if(grown == NULL) return -1;
+        cities = grown;
+        
+        int *grownOrder = realloc(cityOrder, sizeof(int) * newCapacity);
+        if(grownOrder == NULL) return -1;
+        cityOrder = grownOrder;
+        cityCapacity = newCapacity;
+    }
+    
+    int id = cityCount;
+    memset(&cities[id], 0, sizeof(City));
+    snprintf(cities[id].name, CITY_LENGTH, "%s", name);
+    foldName(cities[id].folded, name);
+    cities[id].hash = foldedNameHash(cities[id].folded);
+    
+    int pos = cityLowerBound(cities[id].folded);
+    memmove(&cityOrder[pos + 1], &cityOrder[pos], sizeof(int) * (cityCount - pos));
+    cityOrder[pos] = id;
+    cityCount++;
+    
+    if(cityCount * 2 > citySlotCount) {
+        rebuildCityIndex();
+    } else {
+        insertCitySlot(id);
+    }
+    return id;
+}
+
+int internCity(const char name[]) {
+    int id = findCity(name);
+    return id != -1 ? id : addCity(name);
+}
+
+// Replaces the city table with the names stored in a data file.
+void loadCities(const CityRecord *records, int count) {
+    for(int i = 0; i < cityCount; i++) {
+        free(cities[i].routeList);
+    }
+    cityCount = 0;
+    for(int i = 0; i < citySlotCount; i++) {
+        citySlots[i] = -1;
+    }
+    
+    for(int i = 0; i < count; i++) {
+        if(addCity(records[i].name) == -1) {
+            printf("Unable to allocate city table!\n");
+            exit(1);
+        }
+    }
+}
+
+// Only cities that some route ends in count as destinations.
+int findDestination(const char destination[]) {
+    int id = findCity(destination);
+    return id != -1 && cities[id].routeListCount > 0 ? id : -1;
+}
+
+void indexRouteDestination(int routeIndex) {
+    City *dest = &cities[routes[routeIndex].destinationCity];
+    if(dest->routeListCount == dest->routeListCapacity) {
+        int newCapacity = dest->routeListCapacity > 0 ? dest->routeListCapacity * 2 : 4;
+        int *grown = realloc(dest->routeList, sizeof(int) * newCapacity);
+        if(grown == NULL) return;
+        dest->routeList = grown;
+        dest->routeListCapacity = newCapacity;
+    }
+    dest->routeList[dest->routeListCount++] = routeIndex;
+}
+
+void adjustDestinationBookings(int routeIndex, int delta) {
+    __atomic_add_fetch(&cities[routes[routeIndex].destinationCity].bookingCount, delta, __ATOMIC_RELAXED);
+}
+
+void rebuildDestinationIndex() {
+    for(int i = 0; i < cityCount; i++) {
+        free(cities[i].routeList);
+        cities[i].routeList = NULL;
+        cities[i].routeListCount = 0;
+        cities[i].routeListCapacity = 0;
+        cities[i].bookingCount = 0;
+    }
+    
+    for(int i = 0; i < routeCount; i++) {
+        indexRouteDestination(i);
+    }
+    for(int i = 0; i < routeCount; i++) {
+        adjustDestinationBookings(i, bookedSeatCount(&routes[i]));
+    }
+}
+
+// Fills results with the ids of the most-booked destinations starting with
+// prefix (best first) and returns how many destinations matched in total.
+int completeDestinations(const char prefix[], int results[], int maxResults) {
+    char folded[CITY_LENGTH];
+    foldName(folded, prefix);
+    size_t prefixLength = strlen(folded);
+    
+    int matches = 0;
+    int kept = 0;
+    for(int pos = cityLowerBound(folded); pos < cityCount; pos++) {
+        int id = cityOrder[pos];
+        if(strncmp(cities[id].folded, folded, prefixLength) != 0) break;
+        if(cities[id].routeListCount == 0) continue;
+        matches++;
+        
+        int slot = kept < maxResults ? kept++ : maxResults;
+        while(slot > 0 && cities[results[slot - 1]].bookingCount < cities[id].bookingCount) {
+            if(slot < maxResults) results[slot] = results[slot - 1];
+            slot--;
+        }
+        if(slot < maxResults) results[slot] = id;
+    }
+    return matches;
+}
+
+int lookupOrCreateRoute(char source[], char destination[], int *created) {
+    METRIC_SCOPE(METRIC_FIND_ROUTE);
+    acquireStoreShared();
+    int routeIndex = findRoute(source, destination);
+    releaseStore();
+    
+    *created = 0;
+    if(routeIndex != -1) {
+        return routeIndex;
+    }
+    
+    acquireStoreExclusive();
+    routeIndex = findRoute(source, destination);
+    if(routeIndex != -1) {
+        releaseStore();
+        return routeIndex;
+    }
+    
+    routeIndex = createRoute(source, destination, DEFAULT_DEPARTURE_MINUTE, DEFAULT_TRIP_MINUTES, TOTAL_SEATS);
+    *created = routeIndex != -1;
+    if(routeIndex == -1) METRIC_FAILED();
+    releaseStore();
+    return routeIndex;
+}
+
+int findOrCreateRoute(char source[], char destination[]) {
+    int created;
+    int routeIndex = lookupOrCreateRoute(source, destination, &created);
+    
+    if(created) {
+        printf("New route created: %s to %s at " DEPARTURE_FORMAT "\n", source, destination,
+               DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+    }
+    return routeIndex;
+}
+
+// Free seats of one 64-seat word, with bits past the route's capacity masked off.
+uint64_t freeSeatWord(Route *route, int word) {
+    int firstSeat = word * 64;
+    if(firstSeat >= route->capacity) return 0;
+    
+    uint64_t freeBits = ~__atomic_load_n(&route->seatMap[word], __ATOMIC_RELAXED);
+    int seatsInWord = route->capacity - firstSeat;
+    if(seatsInWord < 64) {
+        freeBits &= (UINT64_C(1) << seatsInWord) - 1;
+    }
+    return freeBits;
+}
+
+int isSeatBooked(Route *route, int seatNumber) {
+    int bit = seatNumber - 1;
+    return (__atomic_load_n(&route->seatMap[bit / 64], __ATOMIC_ACQUIRE) >> (bit % 64)) & 1;
+}
+
+// Atomically claims the seat; returns 0 if someone else already holds it.
+int markSeatBooked(Route *route, int seatNumber) {
+    int bit = seatNumber - 1;
+    uint64_t mask = UINT64_C(1) << (bit % 64);
+    return !(__atomic_fetch_or(&route->seatMap[bit / 64], mask, __ATOMIC_ACQ_REL) & mask);
+}
+
+void markSeatFree(Route *route, int seatNumber) {
+    int bit = seatNumber - 1;
+    __atomic_fetch_and(&route->seatMap[bit / 64], ~(UINT64_C(1) << (bit % 64)), __ATOMIC_RELEASE);
+}
+
+int bookedSeatCount(Route *route) {
+    int count = 0;
+    for(int i = 0; i < SEAT_WORDS; i++) {
+        count += __builtin_popcountll(__atomic_load_n(&route->seatMap[i], __ATOMIC_RELAXED));
+    }
+    return count;
+}
+
+int freeSeatCount(Route *route) {
+    return route->capacity - bookedSeatCount(route);
+}
+
+// Returns the lowest free seat number >= fromSeat, or 0 when none is left.
+int nextFreeSeat(Route *route, int fromSeat) {
+    if(fromSeat < 1) fromSeat = 1;
+    if(fromSeat > route->capacity) return 0;
+    
+    int word = (fromSeat - 1) / 64;
+    uint64_t freeBits = freeSeatWord(route, word) & (~UINT64_C(0) << ((fromSeat - 1) % 64));
+    
+    while(1) {
+        if(freeBits != 0) {
+            return word * 64 + __builtin_ctzll(freeBits) + 1;
+        }
+        if(++word >= SEAT_WORDS) return 0;
+        freeBits = freeSeatWord(route, word);
+    }
+}
+
+// seatOwners[route][seat - 1] holds the booking handle sitting in that seat,
+// so ticket lookups go straight from (route, seat) to the booking.
+int resizeSeatOwners(int routeIndex, int capacity) {
+    int oldCapacity = seatOwners[routeIndex] != NULL ? routes[routeIndex].capacity : 0;
+    int *owners = realloc(seatOwners[routeIndex], sizeof(int) * capacity);
+    if(owners == NULL) return 0;
+    
+    for(int i = oldCapacity; i < capacity; i++) {
+        owners[i] = -1;
+    }
+    seatOwners[routeIndex] = owners;
+    return 1;
+}
+
+// Seat words are rebuilt from the live bookings too, so a seat claimed by an
+// operation that never reached the journal does not stay taken.
+void rebuildSeatOwners() {
+    for(int i = 0; i < routeCount; i++) {
+        memset(routes[i].seatMap, 0, sizeof(routes[i].seatMap));
+        free(seatOwners[i]);
+        seatOwners[i] = NULL;
+        if(!resizeSeatOwners(i, routes[i].capacity)) {
+            printf("Unable to allocate seats for route!\n");
+            exit(1);
+        }
+    }
+    
+    int live[BOOKING_SCAN_BATCH];
+    int cursor = 0;
+    int found;
+    while((found = scanBookings(&cursor, live, BOOKING_SCAN_BATCH)) > 0) {
+        for(int k = 0; k < found; k++) {
+            int i = live[k];
+            int routeIndex = bookingRoutes[i];
+            if(routeIndex >= 0 && routeIndex < routeCount &&
+               bookings[i].seatNo >= 1 && bookings[i].seatNo <= routes[routeIndex].capacity) {
+                seatOwners[routeIndex][bookings[i].seatNo - 1] = i;
+                markSeatBooked(&routes[routeIndex], bookings[i].seatNo);
+            }
+        }
+    }
+}
+
+int seatBooking(int routeIndex, int seatNumber) {
+    if(routeIndex < 0 || routeIndex >= routeCount ||
+       seatNumber < 1 || seatNumber > routes[routeIndex].capacity) {
+        return -1;
+    }
+    return __atomic_load_n(&seatOwners[routeIndex][seatNumber - 1], __ATOMIC_ACQUIRE);
+}
+
+int findBookingByDestinationSeat(char destination[], int seatNumber) {
+    int id = findDestination(destination);
+    if(id == -1) return -1;
+    
+    for(int i = 0; i < cities[id].routeListCount; i++) {
+        int routeIndex = cities[id].routeList[i];
+        if(routes[routeIndex].isActive) {
+            int bookingIndex = seatBooking(routeIndex, seatNumber);
+            if(bookingIndex != -1) return bookingIndex;
+        }
+    }
+    return -1;
+}
+
+// Shows the seats of the corridor's first bus. When it is full, offers the
+// next departure that still has a seat, or adds a bus an hour after the last
+// one if none does. Returns the route the passenger settled on, or -1.
+int viewAvailableSeatsForRoute(char source[], char destination[]) {
+    int routeIndex = findOrCreateRoute(source, destination);
+    if(routeIndex == -1) return -1;
+    
+    if(printAvailableSeats(routeIndex) > 0) {
+        return routeIndex;
+    }
+    printf("No available seats on this bus!\n");
+    
+    acquireStoreShared();
+    int corridor = routeCorridors[routeIndex];
+    int nextRouteIndex = nextDeparture(corridor, routes[routeIndex].departureMinute, 1);
+    Corridor *entry = &corridors[corridor];
+    int lastMinute = routes[entry->departures[entry->departureCount - 1]].departureMinute;
+    releaseStore();
+    
+    int newMinute = (lastMinute + 60) % MINUTES_PER_DAY;
+    if(nextRouteIndex != -1) {
+        printf("Next bus with free seats leaves at " DEPARTURE_FORMAT ". Would you like to book on it? (y/n): ",
+               DEPARTURE_ARGS(routes[nextRouteIndex].departureMinute));
+    } else {
+        printf("Next bus available at " DEPARTURE_FORMAT ". Would you like to book on next bus? (y/n): ",
+               DEPARTURE_ARGS(newMinute));
+    }
+    
+    char nextBusChoice;
+    scanf("%c", &nextBusChoice);
+    clearInputBuffer();
+    if(tolower(nextBusChoice) != 'y') return -1;
+    
+    if(nextRouteIndex == -1) {
+        nextRouteIndex = addDeparture(source, destination, newMinute, routes[routeIndex].durationMinutes);
+        if(nextRouteIndex == -1) {
+            printf("Cannot create more routes!\n");
+            return -1;
+        }
+        printf("Next bus created at " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(newMinute));
+    }
+    
+    printAvailableSeats(nextRouteIndex);
+    return nextRouteIndex;
+}
+
+// Prints the free seats of one departure and returns how many there are.
+int printAvailableSeats(int routeIndex) {
+    Route *route = &routes[routeIndex];
+    printf("\n=== AVAILABLE SEATS FOR %s to %s ===\n", cityName(route->sourceCity), cityName(route->destinationCity));
+    printf("Bus Time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(route->departureMinute));
+    printf("Available Seats: %d/%d\n", freeSeatCount(route), route->capacity);
+    
+    int availableCount = 0;
+    for(int seat = nextFreeSeat(route, 1); seat != 0; seat = nextFreeSeat(route, seat + 1)) {
+        printf("Seat %02d ", seat);
+        availableCount++;
+        
+        if((availableCount) % 4 == 0) {
+            printf("\n");
+        }
+    }
+    
+    if(availableCount % 4 != 0) {
+        printf("\n");
+    }
+    return availableCount;
+}
+
+void bookTicket() {
+    char source[SOURCE_LENGTH];
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== BOOK TICKET ===\n");
+    printf("Enter source: ");
+    fgets(source, SOURCE_LENGTH, stdin);
+    source[strcspn(source, "\n")] = 0;
+    
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    int routeIndex = viewAvailableSeatsForRoute(source, destination);
+    if(routeIndex == -1 || freeSeatCount(&routes[routeIndex]) == 0) {
+        return;
+    }
+    
+    int seatNumber;
+    printf("\nEnter seat number to book: ");
+    scanf("%d", &seatNumber);
+    clearInputBuffer();
+    
+    if(seatNumber < 1 || seatNumber > routes[routeIndex].capacity) {
+        printf("Invalid seat number! Please enter between 1 and %d.\n", routes[routeIndex].capacity);
+        return;
+    }
+    
+    if(isSeatBooked(&routes[routeIndex], seatNumber)) {
+        printf("Seat %d is already booked on this bus!\n", seatNumber);
+        return;
+    }
+    
+    int64_t hold = holdSeat(routeIndex, seatNumber, HOLD_DEFAULT_SECONDS);
+    if(hold == BOOK_SEAT_TAKEN) {
+        printf("Seat %d was just booked by someone else!\n", seatNumber);
+        return;
+    }
+    if(hold < 0) {
+        printf("Booking system error!\n");
+        return;
+    }
+    printf("Seat %d is held for you for %d seconds.\n", seatNumber, HOLD_DEFAULT_SECONDS);
+    
+    char name[NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    
+    printf("Enter passenger name: ");
+    fgets(name, NAME_LENGTH, stdin);
+    name[strcspn(name, "\n")] = 0;
+    
+    printf("Enter phone number: ");
+    fgets(phone, PHONE_LENGTH, stdin);
+    phone[strcspn(phone, "\n")] = 0;
+    
+    int choice = choosePaymentMethod();
+    int i = confirmHold(hold, name, phone, choice);
+    if(i == BOOK_HOLD_EXPIRED) {
+        printf("Your hold on seat %d expired; please book again.\n", seatNumber);
+        return;
+    }
+    if(i < 0) {
+        printf("Booking system error!\n");
+        return;
+    }
+    
+    printPaymentSummary(bookings[i].paymentID);
+    printf("\nTicket booked successfully!\n");
+    printTicket(seatNumber, routeIndex);
+}
+
+void bookGroupTicket() {
+    char source[SOURCE_LENGTH];
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== GROUP BOOKING ===\n");
+    printf("Enter source: ");
+    fgets(source, SOURCE_LENGTH, stdin);
+    source[strcspn(source, "\n")] = 0;
+    
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    int routeIndex = viewAvailableSeatsForRoute(source, destination);
+    if(routeIndex == -1) {
+        return;
+    }
+    
+    int count;
+    int freeSeats = freeSeatCount(&routes[routeIndex]);
+    printf("\nEnter number of travellers: ");
+    scanf("%d", &count);
+    clearInputBuffer();
+    
+    if(count < 1 || count > freeSeats) {
+        printf("Invalid group size! This bus has %d free seats.\n", freeSeats);
+        return;
+    }
+    
+    char name[NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    
+    printf("Enter lead passenger name: ");
+    fgets(name, NAME_LENGTH, stdin);
+    name[strcspn(name, "\n")] = 0;
+    
+    printf("Enter phone number: ");
+    fgets(phone, PHONE_LENGTH, stdin);
+    phone[strcspn(phone, "\n")] = 0;
+    
+    int choice = choosePaymentMethod();
+    int *bookingIndexes = malloc(sizeof(int) * count);
+    if(bookingIndexes == NULL) {
+        printf("Booking system error!\n");
+        return;
+    }
+    
+    int booked = bookGroup(routeIndex, count, name, phone, choice, bookingIndexes);
+    if(booked == BOOK_SEAT_TAKEN) {
+        printf("Those seats were just booked by someone else!\n");
+    } else if(booked < 0) {
+        printf("Booking system error!\n");
+    } else {
+        int first = bookings[bookingIndexes[0]].seatNo;
+        int last = bookings[bookingIndexes[booked - 1]].seatNo;
+        printPaymentSummary(bookings[bookingIndexes[0]].paymentID);
+        printf("\nGroup of %d booked successfully%s!\n", booked,
+               last - first == booked - 1 ? " on adjacent seats" : "");
+        printGroupTicket(bookingIndexes, booked);
+    }
+    free(bookingIndexes);
+}
+
+// Claims the seat, fills in the booking and its payment, and journals both.
+// Caller holds storeLock shared; returns the booking handle or a BOOK_* code.
+int reserveSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice) {
+    if(routeIndex < 0 || routeIndex >= routeCount ||
+       seatNumber < 1 || seatNumber > routes[routeIndex].capacity) {
+        return BOOK_INVALID_SEAT;
+    }
+    
+    if(!markSeatBooked(&routes[routeIndex], seatNumber)) {
+        return BOOK_SEAT_TAKEN;
+    }
+    refreshDeparture(routeIndex);
+    
+    int i = reserveClaimedSeat(routeIndex, seatNumber, name, phone, paymentChoice);
+    if(i < 0) {
+        markSeatFree(&routes[routeIndex], seatNumber);
+        refreshDeparture(routeIndex);
+    }
+    return i;
+}
+
+// Books a seat whose bit the caller already set, by reserveSeat or a hold.
+// The claim stays in place while a full table grows, so nobody can take the
+// seat in the gap; on failure it is still the caller's to hand back. Caller
+// holds storeLock shared.
+int reserveClaimedSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice) {
+    int i, paymentID;
+    while(1) {
+        i = allocateBooking();
+        paymentID = i != -1 ? claimPaymentSlot() : -1;
+        if(paymentID != -1) break;
+        
+        // Out of room: nothing is published yet, so hand back the slot,
+        // grow, and try again.
+        if(i != -1) releaseBooking(i);
+        
+        int grown = i == -1 ? growWhileShared(ensureBookingCapacity, bookingCapacity + 1)
+                            : growWhileShared(ensurePaymentCapacity, paymentCapacity + 1);
+        if(!grown) return BOOK_NO_SPACE;
+    }
+    
+    pthread_mutex_lock(routeLock(routeIndex));
+    recordPayment(paymentID, i, paymentChoice, 1);
+    publishBooking(i, routeIndex, seatNumber, name, phone);
+    pthread_mutex_unlock(routeLock(routeIndex));
+    return i;
+}
+
+// Fills in an allocated booking for a claimed seat, makes it live and
+// journals it; its payment is recorded first. Caller holds storeLock shared
+// and the route's lock.
+void publishBooking(int bookingIndex, int routeIndex, int seatNumber, const char name[], const char phone[]) {
+    bookings[bookingIndex].bookedAt = time(NULL);
+    bookings[bookingIndex].seatNo = seatNumber;
+    bookings[bookingIndex].routeID = routeIndex;
+    snprintf(bookings[bookingIndex].name, NAME_LENGTH, "%s", name);
+    snprintf(bookings[bookingIndex].phone, PHONE_LENGTH, "%s", phone);
+    
+    // The phone links of a booking change whenever a neighbour in its chain
+    // does, so the journal gets a copy taken under the phone index lock.
+    pthread_mutex_lock(&phoneIndexLock);
+    setBookingLive(bookingIndex, 1);
+    indexBookingPhone(bookingIndex);
+    Booking image = bookings[bookingIndex];
+    pthread_mutex_unlock(&phoneIndexLock);
+    
+    __atomic_store_n(&seatOwners[routeIndex][seatNumber - 1], bookingIndex, __ATOMIC_RELEASE);
+    adjustDestinationBookings(routeIndex, 1);
+    __atomic_add_fetch(&bookedSeats, 1, __ATOMIC_RELAXED);
+    journalAppend(JOURNAL_BOOKING, bookingIndex, &image, sizeof(Booking));
+}
+
+int bookSeat(int routeIndex, int seatNumber, const char name[], const char phone[], int paymentChoice) {
+    METRIC_SCOPE(METRIC_BOOK);
+    acquireStoreShared();
+    expireHolds();
+    int i = reserveSeat(routeIndex, seatNumber, name, phone, paymentChoice);
+    if(i >= 0) {
+        journalCommit();
+    } else {
+        METRIC_FAILED();
+    }
+    releaseStore();
+    return i;
+}
+
+// Shifts a seat mask down by shift seats: bit i of out is bit i + shift of in.
+void shiftSeatMask(const uint64_t in[], uint64_t out[], int shift) {
+    int words = shift / 64;
+    int bits = shift % 64;
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        uint64_t low = w + words < SEAT_WORDS ? in[w + words] : 0;
+        uint64_t high = w + words + 1 < SEAT_WORDS ? in[w + words + 1] : 0;
+        out[w] = bits ? (low >> bits) | (high << (64 - bits)) : low;
+    }
+}
+
+// Picks count free seats into chosen in one pass over the seat map. Runs are
+// found by shift-AND across the words: bit i of runs stays set while seats
+// i + 1 to i + length are all free, and each step at least doubles length. With
+// no run long enough, the count free seats spanning the fewest seat numbers
+// are taken instead. Returns 1 for a run, 0 for a cluster, -1 if fewer than
+// count seats are free.
+int findSeatGroup(Route *route, int count, uint64_t chosen[]) {
+    uint64_t freeSeats[SEAT_WORDS], runs[SEAT_WORDS], shifted[SEAT_WORDS];
+    int freeTotal = 0;
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        freeSeats[w] = runs[w] = freeSeatWord(route, w);
+        freeTotal += __builtin_popcountll(freeSeats[w]);
+        chosen[w] = 0;
+    }
+    if(count < 1 || freeTotal < count) return -1;
+    
+    for(int length = 1; length < count; ) {
+        int step = length < count - length ? length : count - length;
+        shiftSeatMask(runs, shifted, step);
+        for(int w = 0; w < SEAT_WORDS; w++) {
+            runs[w] &= shifted[w];
+        }
+        length += step;
+    }
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        if(runs[w] == 0) continue;
+        
+        int first = w * 64 + __builtin_ctzll(runs[w]);
+        for(int bit = first; bit < first + count; bit++) {
+            chosen[bit / 64] |= UINT64_C(1) << (bit % 64);
+        }
+        return 1;
+    }
+    
+    int positions[MAX_SEATS_PER_ROUTE];
+    int found = 0;
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        for(uint64_t bits = freeSeats[w]; bits != 0; bits &= bits - 1) {
+            positions[found++] = w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    int best = 0;
+    for(int i = 1; i + count <= found; i++) {
+        if(positions[i + count - 1] - positions[i] < positions[best + count - 1] - positions[best]) {
+            best = i;
+        }
+    }
+    for(int i = best; i < best + count; i++) {
+        chosen[positions[i] / 64] |= UINT64_C(1) << (positions[i] % 64);
+    }
+    return 0;
+}
+
+// Claims every seat in mask or none: if another claim got to one of them
+// first, the bits already set are handed back and 0 is returned.
+int claimSeatGroup(Route *route, const uint64_t mask[]) {
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        uint64_t before = __atomic_fetch_or(&route->seatMap[w], mask[w], __ATOMIC_ACQ_REL);
+        if(before & mask[w]) {
+            __atomic_fetch_and(&route->seatMap[w], ~(mask[w] & ~before), __ATOMIC_RELEASE);
+            while(--w >= 0) {
+                __atomic_fetch_and(&route->seatMap[w], ~mask[w], __ATOMIC_RELEASE);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void releaseSeatGroup(Route *route, const uint64_t mask[]) {
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        __atomic_fetch_and(&route->seatMap[w], ~mask[w], __ATOMIC_RELEASE);
+    }
+}
+
+// The group version of reserveClaimedSeat: one booking per seat in mask, in
+// seat order, all sharing a single payment for count fares. Booking slots
+// taken before a table grows are kept. Caller holds storeLock shared; on
+// failure the seats are still the caller's to hand back.
+int reserveSeatGroup(int routeIndex, const uint64_t mask[], int count, const char name[], const char phone[],
+                     int paymentChoice, int bookingIndexes[]) {
+    int allocated = 0;
+    int paymentID = -1;
+    while(1) {
+        while(allocated < count && (bookingIndexes[allocated] = allocateBooking()) != -1) {
+            allocated++;
+        }
+        if(allocated == count && (paymentID = claimPaymentSlot()) != -1) break;
+        
+        int grown = allocated < count ? growWhileShared(ensureBookingCapacity, bookingCapacity + count - allocated)
+                                      : growWhileShared(ensurePaymentCapacity, paymentCapacity + 1);
+        if(!grown) {
+            while(allocated > 0) {
+                releaseBooking(bookingIndexes[--allocated]);
+            }
+            return BOOK_NO_SPACE;
+        }
+    }
+    
+    pthread_mutex_lock(routeLock(routeIndex));
+    recordPayment(paymentID, bookingIndexes[0], paymentChoice, count);
+    int k = 0;
+    for(int w = 0; w < SEAT_WORDS; w++) {
+        for(uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+            bookings[bookingIndexes[k]].paymentID = paymentID;
+            publishBooking(bookingIndexes[k], routeIndex, w * 64 + __builtin_ctzll(bits) + 1, name, phone);
+            k++;
+        }
+    }
+    pthread_mutex_unlock(routeLock(routeIndex));
+    return count;
+}
+
+// Books count seats on the route in one operation under one payment:
+// adjacent seats when a free run is long enough, otherwise the tightest
+// cluster. Fills bookingIndexes in seat order and returns count, or a BOOK_*
+// code; BOOK_SEAT_TAKEN means too few seats are free.
+int bookGroup(int routeIndex, int count, const char name[], const char phone[], int paymentChoice, int bookingIndexes[]) {
+    METRIC_SCOPE(METRIC_BOOK);
+    acquireStoreShared();
+    expireHolds();
+    
+    int result = BOOK_INVALID_SEAT;
+    if(routeIndex >= 0 && routeIndex < routeCount && count >= 1 && count <= routes[routeIndex].capacity) {
+        uint64_t chosen[SEAT_WORDS];
+        result = BOOK_SEAT_TAKEN;
+        
+        // A claim only fails when a racing booking took one of the chosen
+        // seats, so look again with that seat gone.
+        for(int attempt = 0; attempt < GROUP_CLAIM_ATTEMPTS; attempt++) {
+            if(findSeatGroup(&routes[routeIndex], count, chosen) == -1) break;
+            if(claimSeatGroup(&routes[routeIndex], chosen)) {
+                result = 0;
+                break;
+            }
+        }
+        
+        if(result == 0) {
+            refreshDeparture(routeIndex);
+            result = reserveSeatGroup(routeIndex, chosen, count, name, phone, paymentChoice, bookingIndexes);
+            if(result < 0) {
+                releaseSeatGroup(&routes[routeIndex], chosen);
+                refreshDeparture(routeIndex);
+            }
+        }
+    }
+    
+    if(result > 0) {
+        journalCommit();
+    } else {
+        METRIC_FAILED();
+    }
+    releaseStore();
+    return result;
+}
+
+uint64_t currentHoldTick() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000) / HOLD_TICK_MS;
+}
+
+// New entries join the free chain. Caller holds holdLock.
+int ensureHoldCapacity(int needed) {
+    if(needed <= holdCapacity) return 1;
+    
+    int newCapacity = holdCapacity > 0 ? holdCapacity : INITIAL_HOLD_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    SeatHold *grown = realloc(holds, sizeof(SeatHold) * newCapacity);
+    if(grown == NULL) return 0;
+    
+    for(int i = newCapacity - 1; i >= holdCapacity; i--) {
+        memset(&grown[i], 0, sizeof(SeatHold));
+        grown[i].generation = 1;
+        grown[i].next = holdFreeHead;
+        holdFreeHead = i;
+    }
+    holds = grown;
+    holdCapacity = newCapacity;
+    return 1;
+}
+
+// Forgets every hold. Holds are never journaled, so after a load the seat
+// words rebuilt from the bookings already leave their seats free.
+void resetHolds() {
+    pthread_mutex_lock(&holdLock);
+    for(int i = 0; i < HOLD_WHEEL_LEVELS * HOLD_WHEEL_SLOTS; i++) {
+        holdWheel[i] = -1;
+    }
+    holdFreeHead = -1;
+    for(int i = holdCapacity - 1; i >= 0; i--) {
+        if(holds[i].live) {
+            holds[i].generation = (holds[i].generation + 1) & HOLD_GENERATION_MASK;
+            if(holds[i].generation == 0) holds[i].generation = 1;
+        }
+        holds[i].live = 0;
+        holds[i].next = holdFreeHead;
+        holdFreeHead = i;
+    }
+    activeHolds = 0;
+    __atomic_store_n(&holdWheelTick, currentHoldTick(), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&holdLock);
+}
+
+// Files a hold at the lowest level whose bucket span still separates its
+// expiry from the current tick, in the bucket for its expiry at that level.
+// Caller holds holdLock.
+void fileHold(int holdIndex) {
+    SeatHold *hold = &holds[holdIndex];
+    uint64_t differs = hold->expiresTick ^ holdWheelTick;
+    int level = 0;
+    while(level < HOLD_WHEEL_LEVELS - 1 && (differs >> (HOLD_WHEEL_BITS * (level + 1))) != 0) {
+        level++;
+    }
+    
+    int slot = (int)(hold->expiresTick >> (HOLD_WHEEL_BITS * level)) & (HOLD_WHEEL_SLOTS - 1);
+    hold->bucket = level * HOLD_WHEEL_SLOTS + slot;
+    hold->prev = -1;
+    hold->next = holdWheel[hold->bucket];
+    if(hold->next != -1) holds[hold->next].prev = holdIndex;
+    holdWheel[hold->bucket] = holdIndex;
+}
+
+void unfileHold(int holdIndex) {
+    SeatHold *hold = &holds[holdIndex];
+    if(hold->prev != -1) {
+        holds[hold->prev].next = hold->next;
+    } else {
+        holdWheel[hold->bucket] = hold->next;
+    }
+    if(hold->next != -1) holds[hold->next].prev = hold->prev;
+}
+
+// Returns an unfiled hold to the free chain and retires its token.
+void freeHold(int holdIndex) {
+    SeatHold *hold = &holds[holdIndex];
+    hold->live = 0;
+    hold->generation = (hold->generation + 1) & HOLD_GENERATION_MASK;
+    if(hold->generation == 0) hold->generation = 1;
+    hold->next = holdFreeHead;
+    holdFreeHead = holdIndex;
+    activeHolds--;
+}
+
+// Moves the wheel up to the current tick. At each tick the higher level
+// buckets that tick starts are emptied into lower levels, highest first, and
+// the level 0 bucket's holds come due: their seats are freed. Cheap when the
+// wheel is current. Caller holds storeLock shared.
+void expireHolds() {
+    uint64_t now = currentHoldTick();
+    if(__atomic_load_n(&holdWheelTick, __ATOMIC_RELAXED) >= now) return;
+    
+    pthread_mutex_lock(&holdLock);
+    while(holdWheelTick < now) {
+        if(activeHolds == 0) {
+            __atomic_store_n(&holdWheelTick, now, __ATOMIC_RELAXED);
+            break;
+        }
+        
+        uint64_t tick = holdWheelTick + 1;
+        __atomic_store_n(&holdWheelTick, tick, __ATOMIC_RELAXED);
+        for(int level = HOLD_WHEEL_LEVELS - 1; level >= 1; level--) {
+            if(tick & ((UINT64_C(1) << (HOLD_WHEEL_BITS * level)) - 1)) continue;
+            
+            int bucket = level * HOLD_WHEEL_SLOTS + ((int)(tick >> (HOLD_WHEEL_BITS * level)) & (HOLD_WHEEL_SLOTS - 1));
+            int holdIndex = holdWheel[bucket];
+            holdWheel[bucket] = -1;
+            while(holdIndex != -1) {
+                int next = holds[holdIndex].next;
+                fileHold(holdIndex);
+                holdIndex = next;
+            }
+        }
+        
+        int holdIndex = holdWheel[tick & (HOLD_WHEEL_SLOTS - 1)];
+        holdWheel[tick & (HOLD_WHEEL_SLOTS - 1)] = -1;
+        while(holdIndex != -1) {
+            int next = holds[holdIndex].next;
+            markSeatFree(&routes[holds[holdIndex].routeIndex], holds[holdIndex].seatNumber);
+            refreshDeparture(holds[holdIndex].routeIndex);
+            freeHold(holdIndex);
+            holdIndex = next;
+        }
+    }
+    pthread_mutex_unlock(&holdLock);
+}
+
+// Unfiles a live hold and hands its claimed seat to the caller; returns 0 if
+// the token is unknown, already used or expired. Caller holds storeLock shared.
+int takeHold(int64_t token, int *routeIndex, int *seatNumber) {
+    int holdIndex = (int)(token & 0xFFFFFFFF);
+    uint32_t generation = (uint32_t)(token >> 32);
+    
+    pthread_mutex_lock(&holdLock);
+    if(token <= 0 || holdIndex < 0 || holdIndex >= holdCapacity || !holds[holdIndex].live ||
+       holds[holdIndex].generation != generation) {
+        pthread_mutex_unlock(&holdLock);
+        return 0;
+    }
+    
+    *routeIndex = holds[holdIndex].routeIndex;
+    *seatNumber = holds[holdIndex].seatNumber;
+    unfileHold(holdIndex);
+    freeHold(holdIndex);
+    pthread_mutex_unlock(&holdLock);
+    return 1;
+}
+
+// Claims the seat for seconds while its buyer pays. Until the hold is
+// confirmed, released or expires the seat counts as booked, but it has no
+// booking and is never journaled. Returns the hold's token or a BOOK_* code.
+int64_t holdSeat(int routeIndex, int seatNumber, int seconds) {
+    if(seconds < 1) seconds = 1;
+    if(seconds > HOLD_MAX_SECONDS) seconds = HOLD_MAX_SECONDS;
+    
+    acquireStoreShared();
+    expireHolds();
+    if(routeIndex < 0 || routeIndex >= routeCount ||
+       seatNumber < 1 || seatNumber > routes[routeIndex].capacity) {
+        releaseStore();
+        return BOOK_INVALID_SEAT;
+    }
+    if(!markSeatBooked(&routes[routeIndex], seatNumber)) {
+        releaseStore();
+        return BOOK_SEAT_TAKEN;
+    }
+    refreshDeparture(routeIndex);
+    
+    pthread_mutex_lock(&holdLock);
+    if(holdFreeHead == -1 && !ensureHoldCapacity(holdCapacity + 1)) {
+        pthread_mutex_unlock(&holdLock);
+        markSeatFree(&routes[routeIndex], seatNumber);
+        refreshDeparture(routeIndex);
+        releaseStore();
+        return BOOK_NO_SPACE;
+    }
+    
+    int holdIndex = holdFreeHead;
+    SeatHold *hold = &holds[holdIndex];
+    holdFreeHead = hold->next;
+    hold->routeIndex = routeIndex;
+    hold->seatNumber = seatNumber;
+    hold->expiresTick = holdWheelTick + ((uint64_t)seconds * 1000 + HOLD_TICK_MS - 1) / HOLD_TICK_MS;
+    hold->live = 1;
+    activeHolds++;
+    fileHold(holdIndex);
+    int64_t token = (int64_t)hold->generation << 32 | holdIndex;
+    pthread_mutex_unlock(&holdLock);
+    
+    releaseStore();
+    return token;
+}
+
+// Books the held seat; returns the booking handle, BOOK_HOLD_EXPIRED if the
+// hold is gone, or another BOOK_* code, in which case the seat is freed.
+int confirmHold(int64_t token, const char name[], const char phone[], int paymentChoice) {
+    METRIC_SCOPE(METRIC_BOOK);
+    acquireStoreShared();
+    expireHolds();
+    
+    int routeIndex, seatNumber;
+    int i = BOOK_HOLD_EXPIRED;
+    if(takeHold(token, &routeIndex, &seatNumber)) {
+        i = reserveClaimedSeat(routeIndex, seatNumber, name, phone, paymentChoice);
+        if(i < 0) {
+            markSeatFree(&routes[routeIndex], seatNumber);
+            refreshDeparture(routeIndex);
+        }
+    }
+    
+    if(i >= 0) {
+        journalCommit();
+    } else {
+        METRIC_FAILED();
+    }
+    releaseStore();
+    return i;
+}
+
+// Frees the held seat at once; returns 0 if the hold was already gone.
+int releaseHold(int64_t token) {
+    acquireStoreShared();
+    expireHolds();
+    
+    int routeIndex, seatNumber;
+    int released = takeHold(token, &routeIndex, &seatNumber);
+    if(released) {
+        markSeatFree(&routes[routeIndex], seatNumber);
+        refreshDeparture(routeIndex);
+    }
+    releaseStore();
+    return released;
+}
+
+// Returns the edited booking handle, or -1 if the seat was not booked.
+int updateSeatDetails(int routeIndex, int seatNumber, const char name[], const char phone[]) {
+    METRIC_SCOPE(METRIC_EDIT);
+    acquireStoreShared();
+    
+    int bookingIndex = -1;
+    if(routeIndex >= 0 && routeIndex < routeCount) {
+        pthread_mutex_lock(routeLock(routeIndex));
+        bookingIndex = seatBooking(routeIndex, seatNumber);
+        if(bookingIndex != -1) {
+            pthread_mutex_lock(&phoneIndexLock);
+            snprintf(bookings[bookingIndex].name, NAME_LENGTH, "%s", name);
+            unindexBookingPhone(bookingIndex);
+            snprintf(bookings[bookingIndex].phone, PHONE_LENGTH, "%s", phone);
+            indexBookingPhone(bookingIndex);
+            Booking image = bookings[bookingIndex];
+            pthread_mutex_unlock(&phoneIndexLock);
+            
+            journalAppend(JOURNAL_BOOKING, bookingIndex, &image, sizeof(Booking));
+        }
+        pthread_mutex_unlock(routeLock(routeIndex));
+    }
+    
+    if(bookingIndex != -1) {
+        journalCommit();
+    } else {
+        METRIC_FAILED();
+    }
+    releaseStore();
+    return bookingIndex;
+}
+
+int choosePaymentMethod() {
+    printf("\n=== PAYMENT ===\n");
+    printf("Base Fare: " MONEY_FORMAT "\n", MONEY_ARGS(BASE_FARE));
+    printf("\nSelect payment method:\n");
+    for(int method = 0; method < PAYMENT_METHOD_COUNT; method++) {
+        printf("%d. %s (" RATE_FORMAT " fee)\n", method + 1, paymentMethods[method].name,
+               RATE_ARGS(paymentMethods[method].feeBasisPoints));
+    }
+    printf("Enter choice (1-%d): ", PAYMENT_METHOD_COUNT);
+    
+    int choice;
+    scanf("%d", &choice);
+    clearInputBuffer();
+    
+    if(choice < 1 || choice > PAYMENT_METHOD_COUNT) {
+        printf("Invalid choice! Using Cash.\n");
+        choice = PAYMENT_CASH + 1;
+    }
+    return choice;
+}
+
+void printPaymentSummary(int paymentID) {
+    Payment *payment = &payments[paymentID];
+    if(paymentMethods[payment->method].hasTransaction) {
+        char transaction[TRANSACTION_ID_LENGTH];
+        printf("Transaction ID: %s\n", formatTransactionID(payment->transactionID, transaction));
+    }
+    
+    printf("\nPayment Summary:\n");
+    printf("Method: %s\n", paymentMethods[payment->method].name);
+    printf("Base Fare: " MONEY_FORMAT "\n", MONEY_ARGS(payment->amount));
+    printf("Fee (" RATE_FORMAT "): " MONEY_FORMAT "\n", RATE_ARGS(payment->feeBasisPoints), MONEY_ARGS(payment->fee));
+    printf("Total Paid: " MONEY_FORMAT "\n", MONEY_ARGS(payment->totalPaid));
+    printf("Status: %s\n", paymentStatusNames[payment->status]);
+}
+
+// Fills in payment paymentID (from claimPaymentSlot) for the booking, charged
+// with the given menu choice (1-5, anything else is treated as Cash). A group
+// pays for all its seats at once, so the fee is worked out on the total.
+void recordPayment(int paymentID, int bookingIndex, int choice, int seats) {
+    METRIC_SCOPE(METRIC_PAYMENT);
+    int method = choice >= 1 && choice <= PAYMENT_METHOD_COUNT ? choice - 1 : PAYMENT_CASH;
+    Payment *payment = &payments[paymentID];
+    
+    payment->paymentID = paymentID;
+    payment->method = method;
+    payment->feeBasisPoints = paymentMethods[method].feeBasisPoints;
+    payment->amount = BASE_FARE * seats;
+    payment->fee = calculateFee(payment->amount, payment->feeBasisPoints);
+    payment->totalPaid = payment->amount + payment->fee;
+    payment->status = PAYMENT_COMPLETED;
+    
+    payment->transactionID = paymentMethods[method].hasTransaction ? nextTransactionID() : 0;
+    
+    bookings[bookingIndex].paymentID = paymentID;
+    journalAppend(JOURNAL_PAYMENT, paymentID, payment, sizeof(Payment));
+}
+
+// Rounds half up to the nearest minor unit.
+int64_t calculateFee(int64_t amount, int feeBasisPoints) {
+    return (amount * feeBasisPoints + FEE_BASIS_POINTS / 2) / FEE_BASIS_POINTS;
+}
+
+// The same calculation over whole columns, with no branches in the loop so
+// the compiler can vectorize it.
+void calculateFees(const int64_t amounts[], const int feeBasisPoints[], int64_t fees[], int count) {
+    for(int i = 0; i < count; i++) {
+        fees[i] = calculateFee(amounts[i], feeBasisPoints[i]);
+    }
+}
+
+// Totals completed payments per method and re-derives every fee from its
+// amount and recorded rate. Returns how many stored fees or totals disagree
+// with the recomputation. Needs storeLock exclusively (or a single-threaded
+// caller), since claimed payment slots may still be being filled in.
+int settlePayments(PaymentSettlement totals[]) {
+    int64_t amounts[SETTLE_BATCH];
+    int rates[SETTLE_BATCH];
+    int64_t fees[SETTLE_BATCH];
+    int mismatches = 0;
+    
+    memset(totals, 0, sizeof(PaymentSettlement) * PAYMENT_METHOD_COUNT);
+    for(int start = 0; start < paymentCount; start += SETTLE_BATCH) {
+        int count = paymentCount - start < SETTLE_BATCH ? paymentCount - start : SETTLE_BATCH;
+        for(int i = 0; i < count; i++) {
+            amounts[i] = payments[start + i].amount;
+            rates[i] = payments[start + i].feeBasisPoints;
+        }
+        calculateFees(amounts, rates, fees, count);
+        
+        for(int i = 0; i < count; i++) {
+            Payment *payment = &payments[start + i];
+            if(payment->status != PAYMENT_COMPLETED ||
+               payment->method < 0 || payment->method >= PAYMENT_METHOD_COUNT) {
+                continue;
+            }
+            mismatches += payment->fee != fees[i] || payment->totalPaid != payment->amount + fees[i];
+            
+            PaymentSettlement *total = &totals[payment->method];
+            total->count++;
+            total->amount += payment->amount;
+            total->fee += payment->fee;
+            total->totalPaid += payment->totalPaid;
+        }
+    }
+    return mismatches;
+}
+
+uint64_t nextTransactionID() {
+    if(transactionSlot == -1) {
+        transactionSlot = __atomic_fetch_add(&nextTransactionSlot, 1, __ATOMIC_RELAXED) % TRANSACTION_SLOTS;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 - TRANSACTION_EPOCH_MS;
+    uint64_t clockStamp = (uint64_t)(ms > 0 ? ms : 0) << TRANSACTION_SEQUENCE_BITS;
+    
+    // A sequence that runs out borrows the next millisecond rather than wrapping.
+    TransactionSlot *slot = &transactionSlots[transactionSlot];
+    uint64_t last = __atomic_load_n(&slot->lastStamp, __ATOMIC_RELAXED);
+    uint64_t stamp;
+    do {
+        stamp = last + 1 > clockStamp ? last + 1 : clockStamp;
+    } while(!__atomic_compare_exchange_n(&slot->lastStamp, &last, stamp, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    
+    uint64_t shard = (uint64_t)transactionNode << TRANSACTION_SLOT_BITS | (uint64_t)transactionSlot;
+    return (stamp >> TRANSACTION_SEQUENCE_BITS) << (TRANSACTION_NODE_BITS + TRANSACTION_SLOT_BITS + TRANSACTION_SEQUENCE_BITS) |
+           shard << TRANSACTION_SEQUENCE_BITS | (stamp & ((1u << TRANSACTION_SEQUENCE_BITS) - 1));
+}
+
+// The slot stamp that produced transactionID, with the shard bits removed.
+uint64_t transactionStamp(uint64_t transactionID) {
+    return (transactionID >> (TRANSACTION_NODE_BITS + TRANSACTION_SLOT_BITS + TRANSACTION_SEQUENCE_BITS)) << TRANSACTION_SEQUENCE_BITS |
+           (transactionID & ((1u << TRANSACTION_SEQUENCE_BITS) - 1));
+}
+
+// Makes every slot continue above transactionID, so IDs stay unique across
+// a restart even if the clock now reads earlier than when it was issued.
+void raiseTransactionFloor(uint64_t transactionID) {
+    uint64_t stamp = transactionStamp(transactionID);
+    for(int i = 0; i < TRANSACTION_SLOTS; i++) {
+        uint64_t last = __atomic_load_n(&transactionSlots[i].lastStamp, __ATOMIC_RELAXED);
+        while(last < stamp) {
+            if(__atomic_compare_exchange_n(&transactionSlots[i].lastStamp, &last, stamp, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        }
+    }
+}
+
+void rebuildTransactionFloor() {
+    uint64_t highest = 0;
+    for(int i = 0; i < paymentCount; i++) {
+        if(payments[i].transactionID > highest) {
+            highest = payments[i].transactionID;
+        }
+    }
+    raiseTransactionFloor(highest);
+}
+
+// "TXN" and 13 Crockford base32 digits, fixed width so text order matches
+// numeric order; 0 prints as "CASH".
+char *formatTransactionID(uint64_t transactionID, char text[]) {
+    static const char digits[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+    
+    if(transactionID == 0) {
+        strcpy(text, "CASH");
+        return text;
+    }
+    memcpy(text, "TXN", 3);
+    for(int i = TRANSACTION_TEXT_DIGITS - 1; i >= 0; i--) {
+        text[3 + i] = digits[transactionID & 31];
+        transactionID >>= 5;
+    }
+    text[3 + TRANSACTION_TEXT_DIGITS] = 0;
+    return text;
+}
+
+void userSignup() {
+    char username[USERNAME_LENGTH];
+    char password[PASSWORD_LENGTH];
+    char confirmPassword[PASSWORD_LENGTH];
+    
+    printf("\n=== USER SIGNUP ===\n");
+    printf("Enter username: ");
+    fgets(username, USERNAME_LENGTH, stdin);
+    username[strcspn(username, "\n")] = 0;
+    
+    pthread_mutex_lock(&userLock);
+    int existing = findUser(username);
+    pthread_mutex_unlock(&userLock);
+    if(existing != -1) {
+        printf("Username already exists! Please choose another.\n");
+        return;
+    }
+    
+    printf("Enter password: ");
+    fgets(password, PASSWORD_LENGTH, stdin);
+    password[strcspn(password, "\n")] = 0;
+    
+    printf("Confirm password: ");
+    fgets(confirmPassword, PASSWORD_LENGTH, stdin);
+    confirmPassword[strcspn(confirmPassword, "\n")] = 0;
+    
+    if(strcmp(password, confirmPassword) != 0) {
+        printf("Passwords do not match!\n");
+        return;
+    }
+    
+    int userIndex = registerUser(username, password);
+    if(userIndex == REGISTER_TAKEN) {
+        printf("Username already exists! Please choose another.\n");
+    } else if(userIndex == REGISTER_INVALID) {
+        printf("Username cannot be empty!\n");
+    } else if(userIndex < 0) {
+        printf("Unable to register user!\n");
+    } else {
+        printf("User registered successfully!\n");
+    }
+}
+
+void userLogin() {
+    char username[USERNAME_LENGTH];
+    char password[PASSWORD_LENGTH];
+    uint8_t token[SESSION_TOKEN_LENGTH];
+    
+    printf("\n=== USER LOGIN ===\n");
+    printf("Enter username: ");
+    fgets(username, USERNAME_LENGTH, stdin);
+    username[strcspn(username, "\n")] = 0;
+    
+    printf("Enter password: ");
+    fgets(password, PASSWORD_LENGTH, stdin);
+    password[strcspn(password, "\n")] = 0;
+    
+    int userIndex = authenticateUser(username, password, token);
+    if(userIndex == -1) {
+        printf("Invalid username or password!\n");
+        return;
+    }
+    
+    currentUserIndex = userIndex;
+    printf("Login successful! Welcome %s\n", username);
+    userMenu();
+}
+
+int fillRandom(void *buffer, size_t length) {
+    uint8_t *bytes = buffer;
+    while(length > 0) {
+        ssize_t got = getrandom(bytes, length, 0);
+        if(got < 0) {
+            if(errno == EINTR) continue;
+            return 0;
+        }
+        bytes += got;
+        length -= (size_t)got;
+    }
+    return 1;
+}
+
+static const uint32_t sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+void sha256Init(Sha256Context *context) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(context->state, initial, sizeof(initial));
+    context->length = 0;
+    context->used = 0;
+}
+
+#define SHA256_ROTATE(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256Compress(uint32_t state[], const uint8_t block[]) {
+    uint32_t w[64];
+    for(int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for(int i = 16; i < 64; i++) {
+        uint32_t s0 = SHA256_ROTATE(w[i - 15], 7) ^ SHA256_ROTATE(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTATE(w[i - 2], 17) ^ SHA256_ROTATE(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for(int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (SHA256_ROTATE(e, 6) ^ SHA256_ROTATE(e, 11) ^ SHA256_ROTATE(e, 25)) +
+                      ((e & f) ^ (~e & g)) + sha256Constants[i] + w[i];
+        uint32_t t2 = (SHA256_ROTATE(a, 2) ^ SHA256_ROTATE(a, 13) ^ SHA256_ROTATE(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256Update(Sha256Context *context, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    context->length += length;
+    while(length > 0) {
+        size_t take = 64 - context->used;
+        if(take > length) take = length;
+        memcpy(context->block + context->used, bytes, take);
+        context->used += take;
+        bytes += take;
+        length -= take;
+        if(context->used == 64) {
+            sha256Compress(context->state, context->block);
+            context->used = 0;
+        }
+    }
+}
+
+void sha256Final(Sha256Context *context, uint8_t digest[]) {
+    uint64_t bits = context->length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t padLength = (context->used < 56 ? 56 : 120) - context->used;
+    for(int i = 0; i < 8; i++) {
+        padding[padLength + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    sha256Update(context, padding, padLength + 8);
+    
+    for(int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t)(context->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(context->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(context->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)context->state[i];
+    }
+}
+
+// PBKDF2-HMAC-SHA256 for a single 32-byte block. The HMAC inner and outer
+// pads are hashed once up front, so each iteration costs two compressions.
+void derivePasswordHash(const char password[], const uint8_t salt[], size_t saltLength,
+                        uint32_t iterations, uint8_t hash[]) {
+    METRIC_SCOPE(METRIC_PASSWORD_HASH);
+    uint8_t key[64] = { 0 };
+    size_t keyLength = strlen(password);
+    if(keyLength > sizeof(key)) {
+        Sha256Context keyContext;
+        sha256Init(&keyContext);
+        sha256Update(&keyContext, password, keyLength);
+        sha256Final(&keyContext, key);
+    } else {
+        memcpy(key, password, keyLength);
+    }
+    
+    uint8_t pad[64];
+    Sha256Context inner, outer;
+    for(int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+    sha256Init(&inner);
+    sha256Update(&inner, pad, sizeof(pad));
+    for(int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+    sha256Init(&outer);
+    sha256Update(&outer, pad, sizeof(pad));
+    
+    static const uint8_t firstBlock[4] = { 0, 0, 0, 1 };
+    uint8_t u[PASSWORD_HASH_LENGTH];
+    Sha256Context context = inner;
+    sha256Update(&context, salt, saltLength);
+    sha256Update(&context, firstBlock, sizeof(firstBlock));
+    sha256Final(&context, u);
+    context = outer;
+    sha256Update(&context, u, sizeof(u));
+    sha256Final(&context, u);
+    memcpy(hash, u, sizeof(u));
+    
+    for(uint32_t n = 1; n < iterations; n++) {
+        context = inner;
+        sha256Update(&context, u, sizeof(u));
+        sha256Final(&context, u);
+        context = outer;
+        sha256Update(&context, u, sizeof(u));
+        sha256Final(&context, u);
+        for(int i = 0; i < PASSWORD_HASH_LENGTH; i++) {
+            hash[i] ^= u[i];
+        }
+    }
+}
+
+// A cheap digest of the password keyed by this process's sessionKey, cached
+// with a session so a repeat login can be checked without PBKDF2.
+void passwordCheck(const User *user, const char password[], uint8_t check[]) {
+    Sha256Context context;
+    sha256Init(&context);
+    sha256Update(&context, sessionKey, sizeof(sessionKey));
+    sha256Update(&context, user->salt, sizeof(user->salt));
+    sha256Update(&context, password, strlen(password));
+    sha256Final(&context, check);
+}
+
+// Compares without an early exit so timing does not reveal the match length.
+int digestsEqual(const uint8_t a[], const uint8_t b[], size_t length) {
+    uint8_t difference = 0;
+    for(size_t i = 0; i < length; i++) {
+        difference |= a[i] ^ b[i];
+    }
+    return difference == 0;
+}
+
+int setUserPassword(User *user, const char password[]) {
+    if(!fillRandom(user->salt, sizeof(user->salt))) return 0;
+    user->iterations = passwordIterations;
+    derivePasswordHash(password, user->salt, sizeof(user->salt), user->iterations, user->passwordHash);
+    return 1;
+}
+
+void insertUserSlot(int userIndex) {
+    int mask = userSlotCount - 1;
+    int pos = foldedNameHash(users[userIndex].username) & mask;
+    while(userSlots[pos] != -1) {
+        pos = (pos + 1) & mask;
+    }
+    userSlots[pos] = userIndex;
+}
+
+// Rebuilds the username hash from users[] after a load. Usernames are
+// case-sensitive, so they are hashed as typed.
+void rebuildUserIndex() {
+    int slotCount = 64;
+    while(slotCount < userCount * 2) {
+        slotCount *= 2;
+    }
+    
+    int *slots = malloc(sizeof(int) * slotCount);
+    if(slots == NULL) {
+        printf("Unable to allocate user index!\n");
+        exit(1);
+    }
+    for(int i = 0; i < slotCount; i++) {
+        slots[i] = -1;
+    }
+    free(userSlots);
+    userSlots = slots;
+    userSlotCount = slotCount;
+    
+    for(int i = 0; i < userCount; i++) {
+        insertUserSlot(i);
+    }
+}
+
+// Callers hold userLock.
+int findUser(const char username[]) {
+    if(userSlotCount == 0) return -1;
+    
+    int mask = userSlotCount - 1;
+    for(int pos = foldedNameHash(username) & mask; userSlots[pos] != -1; pos = (pos + 1) & mask) {
+        if(strcmp(users[userSlots[pos]].username, username) == 0) {
+            return userSlots[pos];
+        }
+    }
+    return -1;
+}
+
+// Hashes the password before taking userLock, then adds and logs the account.
+// Returns the new user index or a REGISTER_ code.
+int registerUser(const char username[], const char password[]) {
+    if(username[0] == 0 || strlen(username) >= USERNAME_LENGTH) return REGISTER_INVALID;
+    
+    User user;
+    memset(&user, 0, sizeof(user));
+    snprintf(user.username, USERNAME_LENGTH, "%s", username);
+    user.isActive = 1;
+    if(!setUserPassword(&user, password)) return REGISTER_NO_SPACE;
+    
+    pthread_mutex_lock(&userLock);
+    if(findUser(username) != -1) {
+        pthread_mutex_unlock(&userLock);
+        return REGISTER_TAKEN;
+    }
+    if(!ensureUserCapacity(userCount + 1)) {
+        pthread_mutex_unlock(&userLock);
+        return REGISTER_NO_SPACE;
+    }
+    
+    int userIndex = userCount++;
+    users[userIndex] = user;
+    if(userCount * 2 > userSlotCount) {
+        rebuildUserIndex();
+    } else {
+        insertUserSlot(userIndex);
+    }
+    appendUserRecord(userIndex);
+    pthread_mutex_unlock(&userLock);
+    return userIndex;
+}
+
+// Checks a password and fills token with the user's session token. A live
+// cached session whose password digest matches is reused without running
+// PBKDF2. Returns the user index, or -1.
+int authenticateUser(const char username[], const char password[], uint8_t token[]) {
+    METRIC_SCOPE(METRIC_LOGIN);
+    
+    pthread_mutex_lock(&userLock);
+    int userIndex = findUser(username);
+    if(userIndex == -1 || !users[userIndex].isActive) {
+        pthread_mutex_unlock(&userLock);
+        METRIC_FAILED();
+        return -1;
+    }
+    User user = users[userIndex];
+    Session session = sessions[userIndex & (SESSION_SLOTS - 1)];
+    pthread_mutex_unlock(&userLock);
+    
+    uint8_t check[PASSWORD_HASH_LENGTH];
+    passwordCheck(&user, password, check);
+    time_t now = time(NULL);
+    
+    if(session.userIndex == userIndex && session.expires > now &&
+       digestsEqual(session.check, check, sizeof(check))) {
+        memcpy(token, session.token, SESSION_TOKEN_LENGTH);
+    } else {
+        uint8_t hash[PASSWORD_HASH_LENGTH];
+        derivePasswordHash(password, user.salt, sizeof(user.salt), user.iterations, hash);
+        if(!digestsEqual(hash, user.passwordHash, sizeof(hash)) ||
+           !fillRandom(token, SESSION_TOKEN_LENGTH)) {
+            METRIC_FAILED();
+            return -1;
+        }
+    }
+    
+    pthread_mutex_lock(&userLock);
+    Session *slot = &sessions[userIndex & (SESSION_SLOTS - 1)];
+    slot->userIndex = userIndex;
+    memcpy(slot->token, token, SESSION_TOKEN_LENGTH);
+    memcpy(slot->check, check, sizeof(check));
+    slot->expires = now + SESSION_TTL_SECONDS;
+    pthread_mutex_unlock(&userLock);
+    return userIndex;
+}
+
+// Accepts a token from an earlier login while its session is cached and
+// unexpired, extending it. Returns the user index, or -1.
+int resumeSession(const char username[], const char tokenText[]) {
+    uint8_t token[SESSION_TOKEN_LENGTH];
+    if(strlen(tokenText) != SESSION_TOKEN_LENGTH * 2) return -1;
+    for(int i = 0; i < SESSION_TOKEN_LENGTH; i++) {
+        if(!isxdigit((unsigned char)tokenText[i * 2]) || !isxdigit((unsigned char)tokenText[i * 2 + 1]) ||
+           sscanf(tokenText + i * 2, "%2hhx", &token[i]) != 1) {
+            return -1;
+        }
+    }
+    
+    time_t now = time(NULL);
+    pthread_mutex_lock(&userLock);
+    int userIndex = findUser(username);
+    Session *session = userIndex == -1 ? NULL : &sessions[userIndex & (SESSION_SLOTS - 1)];
+    if(session == NULL || session->userIndex != userIndex || session->expires <= now ||
+       !users[userIndex].isActive || !digestsEqual(session->token, token, sizeof(token))) {
+        pthread_mutex_unlock(&userLock);
+        return -1;
+    }
+    session->expires = now + SESSION_TTL_SECONDS;
+    pthread_mutex_unlock(&userLock);
+    return userIndex;
+}
+
+char *formatSessionToken(const uint8_t token[], char text[]) {
+    for(int i = 0; i < SESSION_TOKEN_LENGTH; i++) {
+        sprintf(text + i * 2, "%02x", token[i]);
+    }
+    return text;
+}
+
+void userMenu() {
+    int choice;
+    
+    do {
+        printf("\n=== USER MENU ===\n");
+        printf("1. Book a Ticket\n");
+        printf("2. Edit My Reservation\n");
+        printf("3. Cancel My Reservation\n");
+        printf("4. Print My Ticket\n");
+        printf("5. View All Bookings\n");
+        printf("6. Plan a Journey\n");
+        printf("7. Book for a Group\n");
+        printf("8. Logout\n");
+        printf("=================\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1:
+                bookTicket();
+                break;
+            case 2:
+                editReservation();
+                break;
+            case 3:
+                cancelReservation();
+                break;
+            case 4:
+                {
+                    char phone[PHONE_LENGTH];
+                    printf("Enter your phone number: ");
+                    fgets(phone, PHONE_LENGTH, stdin);
+                    phone[strcspn(phone, "\n")] = 0;
+                    
+                    int bookingIndex = firstBookingForPhone(phone);
+                    if(bookingIndex == -1) {
+                        printf("Ticket not found!\n");
+                    }
+                    for(; bookingIndex != -1; bookingIndex = bookings[bookingIndex].nextSamePhone) {
+                        printTicket(bookings[bookingIndex].seatNo, bookings[bookingIndex].routeID);
+                    }
+                }
+                break;
+            case 5:
+                viewAllBookings();
+                break;
+            case 6:
+                planJourneyMenu();
+                break;
+            case 7:
+                bookGroupTicket();
+                break;
+            case 8:
+                printf("Logged out successfully!\n");
+                currentUserIndex = -1;
+                break;
+            default:
+                printf("Invalid choice! Please try again.\n");
+        }
+    } while(choice != 8 && currentUserIndex != -1);
+}
+
+int authenticateAdmin() {
+    char username[USERNAME_LENGTH];
+    char password[PASSWORD_LENGTH];
+    
+    printf("\n=== ADMIN LOGIN ===\n");
+    printf("Enter admin username: ");
+    fgets(username, USERNAME_LENGTH, stdin);
+    username[strcspn(username, "\n")] = 0;
+    
+    printf("Enter admin password: ");
+    fgets(password, PASSWORD_LENGTH, stdin);
+    password[strcspn(password, "\n")] = 0;
+    
+    if(strcmp(username, "admin") == 0 && strcmp(password, "admin123") == 0) {
+        printf("Admin login successful!\n");
+        return 1;
+    }
+    
+    printf("Invalid admin credentials!\n");
+    return 0;
+}
+
+void adminPanel() {
+    int choice;
+    
+    do {
+        printf("\n=== ADMIN PANEL ===\n");
+        printf("1. Search Passenger by Phone\n");
+        printf("2. Search Passenger by Destination\n");
+        printf("3. View All Passenger Details\n");
+        printf("4. Cancel Passenger Reservation\n");
+        printf("5. Print Passenger Ticket\n");
+        printf("6. View All Routes\n");
+        printf("7. Performance Metrics\n");
+        printf("8. Export Report\n");
+        printf("9. Admin Logout\n");
+        printf("===================\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+        clearInputBuffer();
+        
+        switch(choice) {
+            case 1:
+                adminSearchByPhone();
+                break;
+            case 2:
+                adminSearchByDestination();
+                break;
+            case 3:
+                adminViewPassengerDetails();
+                break;
+            case 4:
+                adminCancelReservation();
+                break;
+            case 5:
+                adminPrintTicket();
+                break;
+            case 6:
+                {
+                    printf("\n=== ALL ACTIVE ROUTES ===\n");
+                    for(int i = 0; i < routeCount; i++) {
+                        if(routes[i].isActive) {
+                            printf("Route %d: %s to %s | Time: " DEPARTURE_FORMAT " | Booked: %d/%d\n",
+                                   routes[i].routeID, cityName(routes[i].sourceCity), cityName(routes[i].destinationCity),
+                                   DEPARTURE_ARGS(routes[i].departureMinute), bookedSeatCount(&routes[i]), routes[i].capacity);
+                        }
+                    }
+                }
+                break;
+            case 7:
+                adminViewMetrics();
+                break;
+            case 8:
+                adminExportReport();
+                break;
+            case 9:
+                adminLogout();
+                break;
+            default:
+                printf("Invalid choice! Please try again.\n");
+        }
+    } while(choice != 9);
+}
+
+void adminExportReport() {
+    char format[TIME_LENGTH];
+    char source[SOURCE_LENGTH];
+    char destination[DESTINATION_LENGTH];
+    char from[TIME_LENGTH * 2] = "";
+    char to[TIME_LENGTH * 2] = "";
+    char path[PATH_LENGTH];
+    int kind;
+    
+    printf("\n=== EXPORT REPORT ===\n");
+    printf("1. Bookings\n");
+    printf("2. Routes\n");
+    printf("Select report: ");
+    scanf("%d", &kind);
+    clearInputBuffer();
+    
+    if(kind != 1 && kind != 2) {
+        printf("Invalid report!\n");
+        return;
+    }
+    
+    printf("Format (csv, json, columnar): ");
+    fgets(format, sizeof(format), stdin);
+    format[strcspn(format, "\n")] = 0;
+    
+    printf("Source (blank for any): ");
+    fgets(source, SOURCE_LENGTH, stdin);
+    source[strcspn(source, "\n")] = 0;
+    
+    printf("Destination (blank for any): ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    if(kind == 1) {
+        printf("Booked from (YYYY-MM-DD, blank for any): ");
+        fgets(from, sizeof(from), stdin);
+        from[strcspn(from, "\n")] = 0;
+        
+        printf("Booked to (YYYY-MM-DD, blank for any): ");
+        fgets(to, sizeof(to), stdin);
+        to[strcspn(to, "\n")] = 0;
+    }
+    
+    printf("Output file (- for screen): ");
+    fgets(path, PATH_LENGTH, stdin);
+    path[strcspn(path, "\n")] = 0;
+    
+    ReportFilter filter;
+    const char *problem = parseReportFilter(source, destination, from, to, &filter);
+    if(problem != NULL) {
+        printf("Cannot export: %s!\n", problem);
+        return;
+    }
+    if(parseReportFormat(format) == -1 || path[0] == 0) {
+        printf("Cannot export: choose csv, json or columnar and an output file!\n");
+        return;
+    }
+    
+    long rows = writeReport(path, kind == 1 ? REPORT_BOOKINGS : REPORT_ROUTES, parseReportFormat(format), &filter);
+    if(rows < 0) {
+        printf("Unable to write report to %s!\n", path);
+    } else {
+        printf("Exported %ld rows to %s\n", rows, path);
+    }
+}
+
+void adminSearchByPhone() {
+    char phone[PHONE_LENGTH];
+    
+    printf("\n=== SEARCH BY PHONE NUMBER ===\n");
+    printf("Enter phone number: ");
+    fgets(phone, PHONE_LENGTH, stdin);
+    phone[strcspn(phone, "\n")] = 0;
+    
+    METRIC_SCOPE(METRIC_SEARCH_PHONE);
+    printf("\n=== SEARCH RESULTS ===\n");
+    int found = 0;
+    
+    for(int i = firstBookingForPhone(phone); i != -1; i = bookings[i].nextSamePhone) {
+        found = 1;
+        int routeIndex = bookings[i].routeID;
+        int paymentID = bookings[i].paymentID;
+        
+        printf("\nPassenger Details:\n");
+        printf("Name: %s\n", bookings[i].name);
+        printf("Phone: %s\n", bookings[i].phone);
+        printf("Seat: %d\n", bookings[i].seatNo);
+        printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+        printf("Bus Time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+        
+        if(paymentID != -1) {
+            printf("\nPayment Details:\n");
+            Payment *payment = &payments[paymentID];
+            char transaction[TRANSACTION_ID_LENGTH];
+            printf("Method: %s\n", paymentMethods[payment->method].name);
+            printf("Transaction ID: %s\n", formatTransactionID(payment->transactionID, transaction));
+            printf("Amount: " MONEY_FORMAT "\n", MONEY_ARGS(payment->amount));
+            printf("Fee: " MONEY_FORMAT " (" RATE_FORMAT ")\n", MONEY_ARGS(payment->fee),
+                   RATE_ARGS(payment->feeBasisPoints));
+            printf("Total Paid: " MONEY_FORMAT "\n", MONEY_ARGS(payment->totalPaid));
+            printf("Status: %s\n", paymentStatusNames[payment->status]);
+        }
+        printf("-----------------------------\n");
+    }
+    
+    if(!found) {
+        printf("No passenger found with phone number: %s\n", phone);
+    }
+}
+
+void showDestinationHints(char partialDest[]) {
+    int hints[MAX_DESTINATION_HINTS];
+    int matches = completeDestinations(partialDest, hints, MAX_DESTINATION_HINTS);
+    
+    printf("\nDid you mean? (Destinations starting with '%s'):\n", partialDest);
+    
+    if(matches == 0) {
+        printf("No matching destinations found.\n");
+        printf("Available destinations:\n");
+        matches = completeDestinations("", hints, MAX_DESTINATION_HINTS);
+    }
+    
+    int shown = matches < MAX_DESTINATION_HINTS ? matches : MAX_DESTINATION_HINTS;
+    for(int i = 0; i < shown; i++) {
+        printf("- %s\n", cities[hints[i]].name);
+    }
+    if(matches > shown) {
+        printf("... and %d more\n", matches - shown);
+    }
+}
+
+void adminSearchByDestination() {
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== SEARCH BY DESTINATION ===\n");
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    if(findDestination(destination) == -1) {
+        printf("\nNo exact match found for destination: %s\n", destination);
+        showDestinationHints(destination);
+        
+        printf("\nEnter correct destination from list above: ");
+        fgets(destination, DESTINATION_LENGTH, stdin);
+        destination[strcspn(destination, "\n")] = 0;
+    }
+    
+    METRIC_SCOPE(METRIC_SEARCH_DESTINATION);
+    printf("\n=== PASSENGERS GOING TO %s ===\n", destination);
+    int found = 0;
+    int id = findDestination(destination);
+    
+    for(int r = 0; id != -1 && r < cities[id].routeListCount; r++) {
+        int routeIndex = cities[id].routeList[r];
+        
+        for(int word = 0; word < SEAT_WORDS; word++) {
+            uint64_t booked = routes[routeIndex].seatMap[word];
+            while(booked != 0) {
+                int seat = word * 64 + __builtin_ctzll(booked) + 1;
+                booked &= booked - 1;
+                
+                int i = seatBooking(routeIndex, seat);
+                if(i == -1) continue;
+                
+                found++;
+                int paymentID = bookings[i].paymentID;
+                
+                printf("\nPassenger %d:\n", found);
+                printf("Name: %s\n", bookings[i].name);
+                printf("Phone: %s\n", bookings[i].phone);
+                printf("Seat: %d\n", bookings[i].seatNo);
+                printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+                printf("Bus Time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+                
+                if(paymentID != -1) {
+                    Payment *payment = &payments[paymentID];
+                    char transaction[TRANSACTION_ID_LENGTH];
+                    printf("Payment: %s (TXN: %s)\n", paymentMethods[payment->method].name,
+                           formatTransactionID(payment->transactionID, transaction));
+                    printf("Amount: " MONEY_FORMAT " (Fee: " RATE_FORMAT ")\n", MONEY_ARGS(payment->totalPaid),
+                           RATE_ARGS(payment->feeBasisPoints));
+                }
+                printf("-----------------------------\n");
+            }
+        }
+    }
+    
+    if(!found) {
+        printf("No passengers found going to %s\n", destination);
+    }
+}
+
+void adminViewPassengerDetails() {
+    printf("\n=== ALL PASSENGER DETAILS ===\n");
+    
+    if(bookedSeats == 0) {
+        printf("No bookings found.\n");
+        return;
+    }
+    
+    int count = 0;
+    int live[BOOKING_SCAN_BATCH];
+    int cursor = 0;
+    int found;
+    while((found = scanBookings(&cursor, live, BOOKING_SCAN_BATCH)) > 0) {
+        for(int k = 0; k < found; k++) {
+            int i = live[k];
+            count++;
+            int routeIndex = bookingRoutes[i];
+            int paymentID = bookingPayments[i];
+            
+            printf("\nPassenger %d:\n", count);
+            printf("Name: %s\n", bookings[i].name);
+            printf("Phone: %s\n", bookings[i].phone);
+            printf("Seat: %d\n", bookings[i].seatNo);
+            
+            if(routeIndex != -1) {
+                printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+                printf("Bus Time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+            }
+            
+            if(paymentID != -1) {
+                Payment *payment = &payments[paymentID];
+                char transaction[TRANSACTION_ID_LENGTH];
+                printf("Payment: %s | TXN: %s\n", paymentMethods[payment->method].name,
+                       formatTransactionID(payment->transactionID, transaction));
+                printf("Paid: " MONEY_FORMAT " (Fee: " RATE_FORMAT ")\n", MONEY_ARGS(payment->totalPaid),
+                       RATE_ARGS(payment->feeBasisPoints));
+            }
+            printf("-----------------------------\n");
+        }
+    }
+    
+    printf("Total passengers: %d\n", count);
+}
+
+void adminCancelReservation() {
+    int seatNumber;
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== CANCEL RESERVATION ===\n");
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    printf("Enter seat number: ");
+    scanf("%d", &seatNumber);
+    clearInputBuffer();
+    
+    int i = findBookingByDestinationSeat(destination, seatNumber);
+    if(i == -1) {
+        printf("No reservation found for seat %d to %s\n", seatNumber, destination);
+        return;
+    }
+    
+    int routeIndex = bookings[i].routeID;
+    
+    printf("\nFound passenger:\n");
+    printf("Name: %s\n", bookings[i].name);
+    printf("Phone: %s\n", bookings[i].phone);
+    printf("Seat: %d\n", bookings[i].seatNo);
+    printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+    
+    char confirm;
+    printf("Are you sure you want to cancel? (y/n): ");
+    scanf("%c", &confirm);
+    clearInputBuffer();
+    
+    if(tolower(confirm) == 'y') {
+        cancelSeat(routeIndex, bookings[i].seatNo);
+        
+        printf("Reservation canceled successfully.\n");
+    } else {
+        printf("Cancellation aborted.\n");
+    }
+}
+
+void adminPrintTicket() {
+    int seatNumber;
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== PRINT PASSENGER TICKET ===\n");
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    printf("Enter seat number: ");
+    scanf("%d", &seatNumber);
+    clearInputBuffer();
+    
+    int bookingIndex = findBookingByDestinationSeat(destination, seatNumber);
+    if(bookingIndex == -1) {
+        printf("No booking found for seat %d to %s\n", seatNumber, destination);
+        return;
+    }
+    
+    printTicket(seatNumber, bookings[bookingIndex].routeID);
+}
+
+void adminSetBusDetails() {
+    char source[SOURCE_LENGTH];
+    char destination[DESTINATION_LENGTH];
+    
+    printf("\n=== SET BUS DETAILS ===\n");
+    printf("Enter source: ");
+    fgets(source, SOURCE_LENGTH, stdin);
+    source[strcspn(source, "\n")] = 0;
+    
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    int routeIndex = findRoute(source, destination);
+    
+    if(routeIndex == -1) {
+        printf("Route not found!\n");
+        return;
+    }
+    
+    char busTime[TIME_LENGTH];
+    printf("Current bus time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+    printf("Enter new bus time (HH:MM): ");
+    fgets(busTime, TIME_LENGTH, stdin);
+    busTime[strcspn(busTime, "\n")] = 0;
+    
+    int departureMinute = parseDepartureTime(busTime);
+    if(departureMinute != -1 && setRouteDeparture(routeIndex, departureMinute)) {
+        printf("Bus time updated to " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(departureMinute));
+    } else {
+        printf("Invalid time! Keeping " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+    }
+    
+    int capacity;
+    printf("Current seat capacity: %d\n", routes[routeIndex].capacity);
+    printf("Enter new seat capacity (1-%d, 0 to keep): ", MAX_SEATS_PER_ROUTE);
+    scanf("%d", &capacity);
+    clearInputBuffer();
+    
+    if(capacity == 0) return;
+    
+    if(capacity < 1 || capacity > MAX_SEATS_PER_ROUTE) {
+        printf("Invalid capacity!\n");
+        return;
+    }
+    
+    int result = setRouteCapacity(routeIndex, capacity);
+    if(result < 0) {
+        printf("Seat %d is booked; cannot reduce capacity below it.\n", -result);
+    } else if(result == 0) {
+        printf("Unable to resize route!\n");
+    } else {
+        printf("Seat capacity updated to %d\n", capacity);
+    }
+}
+
+// Returns "HH:MM" as minutes after midnight, or -1 if it is not a valid time.
+int parseDepartureTime(const char text[]) {
+    int hour, minute;
+    char extra;
+    if(sscanf(text, "%d:%d%c", &hour, &minute, &extra) != 2 ||
+       hour < 0 || hour >= 24 || minute < 0 || minute >= 60) {
+        return -1;
+    }
+    return hour * 60 + minute;
+}
+
+// Moving a departure re-sorts its corridor, so this takes storeLock
+// exclusively.
+int setRouteDeparture(int routeIndex, int departureMinute) {
+    if(departureMinute < 0 || departureMinute >= MINUTES_PER_DAY) return 0;
+    
+    acquireStoreExclusive();
+    routes[routeIndex].departureMinute = departureMinute;
+    sortDepartures(routeCorridors[routeIndex]);
+    
+    int position = connectionSlots[routeIndex];
+    if(position != -1) {
+        timetableConnections[position].departure = departureMinute;
+        timetableConnections[position].arrival = departureMinute + routes[routeIndex].durationMinutes;
+        repositionConnection(position);
+    }
+    journalAppend(JOURNAL_ROUTE, routeIndex, &routes[routeIndex], sizeof(Route));
+    journalCommit();
+    releaseStore();
+    return 1;
+}
+
+// Returns 1, 0 if capacity is out of range or the seat table cannot grow, or
+// minus the first booked or held seat above capacity, which blocks a shrink.
+int setRouteCapacity(int routeIndex, int capacity) {
+    if(capacity < 1 || capacity > MAX_SEATS_PER_ROUTE) return 0;
+    
+    acquireStoreExclusive();
+    for(int seat = capacity + 1; seat <= routes[routeIndex].capacity; seat++) {
+        if(isSeatBooked(&routes[routeIndex], seat)) {
+            releaseStore();
+            return -seat;
+        }
+    }
+    
+    if(!resizeSeatOwners(routeIndex, capacity)) {
+        releaseStore();
+        return 0;
+    }
+    routes[routeIndex].capacity = capacity;
+    refreshDeparture(routeIndex);
+    journalAppend(JOURNAL_ROUTE, routeIndex, &routes[routeIndex], sizeof(Route));
+    journalCommit();
+    releaseStore();
+    return 1;
+}
+
+// Formats a journey time as HH:MM, marked "+1" when it falls on the next day.
+char *formatJourneyTime(int minute, char text[]) {
+    int day = minute / MINUTES_PER_DAY;
+    minute %= MINUTES_PER_DAY;
+    if(day > 0) {
+        snprintf(text, JOURNEY_TIME_LENGTH, DEPARTURE_FORMAT "+%d", DEPARTURE_ARGS(minute), day);
+    } else {
+        snprintf(text, JOURNEY_TIME_LENGTH, DEPARTURE_FORMAT, DEPARTURE_ARGS(minute));
+    }
+    return text;
+}
+
+void planJourneyMenu() {
+    char source[SOURCE_LENGTH];
+    char destination[DESTINATION_LENGTH];
+    char earliest[TIME_LENGTH];
+    int seats, mode;
+    
+    printf("\n=== PLAN A JOURNEY ===\n");
+    printf("Enter source: ");
+    fgets(source, SOURCE_LENGTH, stdin);
+    source[strcspn(source, "\n")] = 0;
+    
+    printf("Enter destination: ");
+    fgets(destination, DESTINATION_LENGTH, stdin);
+    destination[strcspn(destination, "\n")] = 0;
+    
+    printf("Leave at or after (HH:MM): ");
+    fgets(earliest, TIME_LENGTH, stdin);
+    earliest[strcspn(earliest, "\n")] = 0;
+    int minute = parseDepartureTime(earliest);
+    if(minute == -1) {
+        printf("Invalid time!\n");
+        return;
+    }
+    
+    printf("Number of seats: ");
+    scanf("%d", &seats);
+    clearInputBuffer();
+    printf("1. Earliest arrival\n");
+    printf("2. Fewest transfers\n");
+    printf("Enter choice: ");
+    scanf("%d", &mode);
+    clearInputBuffer();
+    
+    JourneyLeg legs[MAX_JOURNEY_LEGS];
+    int legCount;
+    acquireStoreShared();
+    int arrival = planJourney(findCity(source), findCity(destination), minute, seats > 0 ? seats : 1,
+                              mode == 2 ? JOURNEY_FEWEST_TRANSFERS : JOURNEY_EARLIEST_ARRIVAL, legs, &legCount);
+    if(arrival == -1) {
+        releaseStore();
+        printf("No journey found from %s to %s!\n", source, destination);
+        return;
+    }
+    
+    char departs[JOURNEY_TIME_LENGTH], arrives[JOURNEY_TIME_LENGTH];
+    printf("\n%d leg(s), arriving %s\n", legCount, formatJourneyTime(arrival, arrives));
+    for(int i = 0; i < legCount; i++) {
+        Route *route = &routes[legs[i].routeIndex];
+        printf("%d. %s %s -> %s %s | %d seats free\n", i + 1,
+               formatJourneyTime(legs[i].departure, departs), cityName(route->sourceCity),
+               cityName(route->destinationCity), formatJourneyTime(legs[i].arrival, arrives),
+               freeSeatCount(route));
+    }
+    releaseStore();
+}
+
+// Adds another bus on the corridor, sized like its first one.
+int addDeparture(char source[], char destination[], int departureMinute, int durationMinutes) {
+    acquireStoreExclusive();
+    int firstRoute = findRoute(source, destination);
+    int capacity = firstRoute != -1 ? routes[firstRoute].capacity : TOTAL_SEATS;
+    int routeIndex = createRoute(source, destination, departureMinute, durationMinutes, capacity);
+    releaseStore();
+    return routeIndex;
+}
+
+int setRouteDuration(int routeIndex, int durationMinutes) {
+    if(durationMinutes < 1 || durationMinutes > MINUTES_PER_DAY) return 0;
+    
+    acquireStoreExclusive();
+    routes[routeIndex].durationMinutes = durationMinutes;
+    if(connectionSlots[routeIndex] != -1) {
+        timetableConnections[connectionSlots[routeIndex]].arrival = routes[routeIndex].departureMinute + durationMinutes;
+    }
+    journalAppend(JOURNAL_ROUTE, routeIndex, &routes[routeIndex], sizeof(Route));
+    journalCommit();
+    releaseStore();
+    return 1;
+}
+
+void adminLogout() {
+    printf("Admin logged out successfully!\n");
+}
+
+void editReservation() {
+    char phone[PHONE_LENGTH];
+    
+    printf("\n=== EDIT RESERVATION ===\n");
+    printf("Enter your phone number: ");
+    fgets(phone, PHONE_LENGTH, stdin);
+    phone[strcspn(phone, "\n")] = 0;
+    
+    int bookingIndex = selectBookingByPhone(phone);
+    if(bookingIndex == -2) return;
+    
+    if(bookingIndex == -1) {
+        printf("No reservation found with phone number: %s\n", phone);
+        return;
+    }
+    
+    printf("\nCurrent Details:\n");
+    printf("Name: %s\n", bookings[bookingIndex].name);
+    printf("Phone: %s\n", bookings[bookingIndex].phone);
+    
+    int routeIndex = bookings[bookingIndex].routeID;
+    if(routeIndex != -1) {
+        printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+    }
+    
+    char name[NAME_LENGTH];
+    char newPhone[PHONE_LENGTH];
+    
+    printf("\nEnter new details:\n");
+    printf("Enter new Name: ");
+    fgets(name, NAME_LENGTH, stdin);
+    name[strcspn(name, "\n")] = 0;
+    
+    printf("Enter new Phone: ");
+    fgets(newPhone, PHONE_LENGTH, stdin);
+    newPhone[strcspn(newPhone, "\n")] = 0;
+    
+    updateSeatDetails(routeIndex, bookings[bookingIndex].seatNo, name, newPhone);
+    
+    printf("Reservation edited successfully.\n");
+}
+
+void cancelReservation() {
+    char phone[PHONE_LENGTH];
+    
+    printf("\n=== CANCEL RESERVATION ===\n");
+    printf("Enter your phone number: ");
+    fgets(phone, PHONE_LENGTH, stdin);
+    phone[strcspn(phone, "\n")] = 0;
+    
+    int bookingIndex = selectBookingByPhone(phone);
+    if(bookingIndex == -2) return;
+    
+    if(bookingIndex == -1) {
+        printf("No reservation found with phone number: %s\n", phone);
+        return;
+    }
+    
+    printf("\nYour Booking Details:\n");
+    printf("Name: %s\n", bookings[bookingIndex].name);
+    printf("Phone: %s\n", bookings[bookingIndex].phone);
+    printf("Seat: %d\n", bookings[bookingIndex].seatNo);
+    
+    int routeIndex = bookings[bookingIndex].routeID;
+    if(routeIndex != -1) {
+        printf("Route: %s to %s\n", cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity));
+        printf("Bus Time: " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+    }
+    
+    char confirm;
+    printf("Are you sure you want to cancel? (y/n): ");
+    scanf("%c", &confirm);
+    clearInputBuffer();
+    
+    if(tolower(confirm) == 'y') {
+        cancelSeat(bookings[bookingIndex].routeID, bookings[bookingIndex].seatNo);
+        printf("Your reservation canceled successfully.\n");
+    } else {
+        printf("Cancellation aborted.\n");
+    }
+}
+
+void viewAllBookings() {
+    printf("\n=== ALL BOOKINGS ===\n");
+    
+    if(bookedSeats == 0) {
+        printf("No bookings found.\n");
+        return;
+    }
+    
+    int count = 0;
+    int live[BOOKING_SCAN_BATCH];
+    int cursor = 0;
+    int found;
+    while((found = scanBookings(&cursor, live, BOOKING_SCAN_BATCH)) > 0) {
+        for(int k = 0; k < found; k++) {
+            int i = live[k];
+            count++;
+            int routeIndex = bookingRoutes[i];
+            
+            printf("%d. Seat %02d | %s | ", count, bookings[i].seatNo, bookings[i].name);
+            if(routeIndex != -1) {
+                printf("%s to %s | " DEPARTURE_FORMAT, cityName(routes[routeIndex].sourceCity), cityName(routes[routeIndex].destinationCity),
+                       DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+            }
+            printf("\n");
+        }
+    }
+    
+    printf("Total bookings: %d\n", count);
+}
+
+// One ticket for a whole group booking, listing every seat and the single
+// combined payment.
+void printGroupTicket(const int bookingIndexes[], int count) {
+    Booking *lead = &bookings[bookingIndexes[0]];
+    Route *route = &routes[lead->routeID];
+    
+    printf("\n");
+    printf("=========================================\n");
+    printf("        GROUP TRANSPORT TICKET\n");
+    printf("=========================================\n");
+    printf(" Passenger:   %s\n", lead->name);
+    printf(" Phone:       %s\n", lead->phone);
+    printf(" Travellers:  %d\n", count);
+    printf(" Seats:       ");
+    for(int i = 0; i < count; i++) {
+        printf("%s%d", i > 0 ? ", " : "", bookings[bookingIndexes[i]].seatNo);
+    }
+    printf("\n");
+    
+    printf(" From:        %s\n", cityName(route->sourceCity));
+    printf(" To:          %s\n", cityName(route->destinationCity));
+    printf(" Bus Time:    " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(route->departureMinute));
+    
+    Payment *payment = &payments[lead->paymentID];
+    char transaction[TRANSACTION_ID_LENGTH];
+    printf(" Payment:     %s\n", paymentMethods[payment->method].name);
+    printf(" TXN ID:      %s\n", formatTransactionID(payment->transactionID, transaction));
+    printf(" Amount:      " MONEY_FORMAT "\n", MONEY_ARGS(payment->totalPaid));
+    printf(" Status:      CONFIRMED\n");
+    
+    printf("=========================================\n");
+    printf("    Thank you for choosing our service!\n");
+    printf("=========================================\n\n");
+}
+
+void printTicket(int seatNumber, int routeIndex) {
+    printf("\n");
+    printf("=========================================\n");
+    printf("           TRANSPORT TICKET\n");
+    printf("=========================================\n");
+    
+    int i = seatBooking(routeIndex, seatNumber);
+    if(i != -1) {
+        printf(" Passenger:   %s\n", bookings[i].name);
+        printf(" Phone:       %s\n", bookings[i].phone);
+        printf(" Seat:        %d\n", seatNumber);
+        
+        printf(" From:        %s\n", cityName(routes[routeIndex].sourceCity));
+        printf(" To:          %s\n", cityName(routes[routeIndex].destinationCity));
+        printf(" Bus Time:    " DEPARTURE_FORMAT "\n", DEPARTURE_ARGS(routes[routeIndex].departureMinute));
+        
+        int paymentID = bookings[i].paymentID;
+        if(paymentID != -1) {
+            char transaction[TRANSACTION_ID_LENGTH];
+            printf(" Payment:     %s\n", paymentMethods[payments[paymentID].method].name);
+            printf(" TXN ID:      %s\n", formatTransactionID(payments[paymentID].transactionID, transaction));
+            printf(" Amount:      " MONEY_FORMAT "\n", MONEY_ARGS(payments[paymentID].totalPaid));
+            printf(" Status:      CONFIRMED\n");
+        }
+    }
+    
+    printf("=========================================\n");
+    printf("    Thank you for choosing our service!\n");
+    printf("=========================================\n\n");
+}
+
+// Users live in users.dat (a checksummed snapshot) plus users.log, to which
+// each signup appends one record. Every log starts with a generation number
+// and the snapshot records the first generation it does not yet contain, so
+// loading replays only the logs newer than the snapshot.
+int ensureUserCapacity(int needed) {
+    if(needed <= userCapacity) return 1;
+    
+    int newCapacity = userCapacity > 0 ? userCapacity : INITIAL_USER_CAPACITY;
+    while(newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    
+    User *grown = realloc(users, sizeof(User) * newCapacity);
+    if(grown == NULL) return 0;
+    
+    users = grown;
+    userCapacity = newCapacity;
+    return 1;
+}
+
+// Called on exit: lets a running compaction finish and makes the log durable.
+void saveUserData() {
+    if(userCompactionStarted) {
+        pthread_join(userCompactionThread, NULL);
+        userCompactionStarted = 0;
+    }
+    if(userLogFile != NULL) {
+        fflush(userLogFile);
+        fsync(fileno(userLogFile));
+    }
+}
+
+void loadUserData() {
+    uint32_t snapshotGeneration = 0;
+    int migrated = 0;
+    FILE *file = fopen("users.dat", "rb");
+    
+    if(file != NULL) {
+        UserSnapshotHeader header;
+        struct stat info;
+        int loaded = 0;
+        
+        if(fstat(fileno(file), &info) == 0 &&
+           fread(&header, sizeof(header), 1, file) == 1 && header.magic == USER_SNAPSHOT_MAGIC) {
+            if(header.version == USER_SNAPSHOT_VERSION &&
+               (uint64_t)info.st_size == sizeof(header) + (uint64_t)header.count * sizeof(User) &&
+               ensureUserCapacity((int)header.count) &&
+               fread(users, sizeof(User), header.count, file) == header.count &&
+               crc32Update(0, users, sizeof(User) * header.count) == header.checksum) {
+                userCount = (int)header.count;
+                loaded = 1;
+            } else if(header.version == USER_SNAPSHOT_LEGACY_VERSION &&
+                      (uint64_t)info.st_size == sizeof(header) + (uint64_t)header.count * sizeof(LegacyUser)) {
+                LegacyUser *legacy = malloc(sizeof(LegacyUser) * (header.count > 0 ? header.count : 1));
+                if(legacy != NULL && fread(legacy, sizeof(LegacyUser), header.count, file) == header.count &&
+                   crc32Update(0, legacy, sizeof(LegacyUser) * header.count) == header.checksum) {
+                    loaded = 1;
+                    for(uint32_t i = 0; loaded && i < header.count; i++) {
+                        loaded = migrateLegacyUser(&legacy[i]);
+                    }
+                    migrated = 1;
+                }
+                free(legacy);
+            }
+        }
+        
+        if(loaded) {
+            snapshotGeneration = header.generation;
+        } else {
+            userCount = 0;
+            printf("users.dat is damaged; loading accounts from the signup log only.\n");
+        }
+        fclose(file);
+    }
+    
+    userLogGeneration = snapshotGeneration;
+    replayUserLog("users.log.old", snapshotGeneration, &migrated);
+    replayUserLog("users.log", snapshotGeneration, &migrated);
+    rebuildUserIndex();
+    
+    // Plaintext accounts were hashed while loading; write them out at once and
+    // drop the old-format logs so no plaintext stays on disk.
+    if(migrated) {
+        if(!storeUserSnapshot(users, userCount, userLogGeneration + 1)) {
+            printf("Unable to rewrite users.dat; new accounts will not be saved.\n");
+            return;
+        }
+        userLogGeneration++;
+        unlink("users.log");
+        userLogRecords = 0;
+    }
+    openUserLog();
+    
+    // The default account is logged once like any signup, so later starts
+    // find it instead of hashing its password again.
+    if(findUser("testuser") == -1) {
+        registerUser("testuser", "password");
+    }
+}
+
+int replayUserLog(const char path[], uint32_t snapshotGeneration, int *migrated) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) return 0;
+    
+    UserLogHeader header;
+    int replayed = 0;
+    
+    if(fread(&header, sizeof(header), 1, file) == 1 && header.generation >= snapshotGeneration &&
+       (header.magic == USER_LOG_MAGIC || header.magic == USER_LOG_LEGACY_MAGIC)) {
+        while(1) {
+            if(header.magic == USER_LOG_MAGIC) {
+                UserLogRecord record;
+                if(fread(&record, sizeof(record), 1, file) != 1 || record.magic != USER_LOG_MAGIC ||
+                   crc32Update(0, &record.user, sizeof(User)) != record.checksum ||
+                   !ensureUserCapacity(userCount + 1)) {
+                    break;
+                }
+                users[userCount++] = record.user;
+            } else {
+                LegacyUserLogRecord record;
+                if(fread(&record, sizeof(record), 1, file) != 1 || record.magic != USER_LOG_LEGACY_MAGIC ||
+                   crc32Update(0, &record.user, sizeof(LegacyUser)) != record.checksum ||
+                   !migrateLegacyUser(&record.user)) {
+                    break;
+                }
+                *migrated = 1;
+            }
+            replayed++;
+        }
+        if(header.generation >= userLogGeneration) {
+            userLogGeneration = header.generation;
+            userLogRecords = replayed;
+        }
+    }
+    fclose(file);
+    return replayed;
+}
+
+// Appends a plaintext account from an old users.dat or log, hashing its
+// password on the way in.
+int migrateLegacyUser(const LegacyUser *legacy) {
+    if(!ensureUserCapacity(userCount + 1)) return 0;
+    
+    char password[PASSWORD_LENGTH];
+    User *user = &users[userCount];
+    memset(user, 0, sizeof(User));
+    snprintf(user->username, USERNAME_LENGTH, "%.*s", USERNAME_LENGTH - 1, legacy->username);
+    snprintf(password, PASSWORD_LENGTH, "%.*s", PASSWORD_LENGTH - 1, legacy->password);
+    user->isActive = legacy->isActive;
+    if(!setUserPassword(user, password)) return 0;
+    
+    userCount++;
+    return 1;
+}
+
+void openUserLog() {
+    userLogFile = fopen("users.log", "ab");
+    if(userLogFile == NULL) {
+        printf("Unable to open users.log; new accounts will not be saved.\n");
+        return;
+    }
+    
+    if(ftell(userLogFile) == 0) {
+        UserLogHeader header = { USER_LOG_MAGIC, userLogGeneration };
+        fwrite(&header, sizeof(header), 1, userLogFile);
+        fflush(userLogFile);
+        userLogRecords = 0;
+    }
+}
+
+void appendUserRecord(int userIndex) {
+    if(userLogFile == NULL) return;
+    
+    UserLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = USER_LOG_MAGIC;
+    record.user = users[userIndex];
+    record.checksum = crc32Update(0, &record.user, sizeof(User));
+    
+    fwrite(&record, sizeof(record), 1, userLogFile);
+    fflush(userLogFile);
+    fdatasync(fileno(userLogFile));
+    
+    if(++userLogRecords >= USER_LOG_COMPACT_RECORDS) {
+        compactUserData();
+    }
+}
+
+// Rotates users.log aside and writes a fresh snapshot on a background thread,
+// so a signup never waits for the whole user table to be rewritten.
+void compactUserData() {
+    if(userCompactionStarted) {
+        pthread_join(userCompactionThread, NULL);
+        userCompactionStarted = 0;
+    }
+    if(access("users.log.old", F_OK) == 0) return;
+    
+    UserSnapshot *snapshot = malloc(sizeof(UserSnapshot));
+    if(snapshot == NULL) return;
+    snapshot->users = malloc(sizeof(User) * (userCount > 0 ? userCount : 1));
+    if(snapshot->users == NULL) {
+        free(snapshot);
+        return;
+    }
+    memcpy(snapshot->users, users, sizeof(User) * userCount);
+    snapshot->count = userCount;
+    
+    fclose(userLogFile);
+    userLogFile = NULL;
+    if(rename("users.log", "users.log.old") != 0) {
+        openUserLog();
+        free(snapshot->users);
+        free(snapshot);
+        return;
+    }
+    
+    userLogGeneration++;
+    snapshot->generation = userLogGeneration;
+    openUserLog();
+    
+    if(pthread_create(&userCompactionThread, NULL, writeUserSnapshot, snapshot) == 0) {
+        userCompactionStarted = 1;
+    } else {
+        writeUserSnapshot(snapshot);
+    }
+}
+
+void *writeUserSnapshot(void *arg) {
+    UserSnapshot *snapshot = arg;
+    storeUserSnapshot(snapshot->users, snapshot->count, snapshot->generation);
+    free(snapshot->users);
+    free(snapshot);
+    return NULL;
+}
+
+// Writes users.dat through a temporary file and, once it is durable, drops
+// the rotated log it replaces. Returns 1 on success.
+int storeUserSnapshot(const User *snapshotUsers, int count, uint32_t generation) {
+    UserSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = USER_SNAPSHOT_MAGIC;
+    header.version = USER_SNAPSHOT_VERSION;
+    header.generation = generation;
+    header.count = (uint32_t)count;
+    header.checksum = crc32Update(0, snapshotUsers, sizeof(User) * count);
+    
+    FILE *file = fopen("users.dat.tmp", "wb");
+    if(file == NULL) return 0;
+    
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             (count == 0 || fwrite(snapshotUsers, sizeof(User), count, file) == (size_t)count) &&
+             fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    
+    if(!ok || rename("users.dat.tmp", "users.dat") != 0) return 0;
+    unlink("users.log.old");
+    return 1;
+}
+
+void saveRoutesData() {
+    METRIC_SCOPE(METRIC_SAVE);
+    char tmpPath[PATH_LENGTH];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", routesDataPath);
+    
+    FILE *file = fopen(tmpPath, "wb");
+    if(file == NULL) {
+        printf("Unable to save routes data!\n");
+        METRIC_FAILED();
+        return;
+    }
+    
+    int bookingHighWater = lastLiveBooking() + 1;
+    
+    DataFileHeader header;
+    DataSection sections[SECTION_COUNT];
+    memset(&header, 0, sizeof(header));
+    memset(sections, 0, sizeof(sections));
+    
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(sections, sizeof(sections), 1, file);
+    
+    CityRecord *cityRecords = malloc(sizeof(CityRecord) * (cityCount > 0 ? cityCount : 1));
+    for(int i = 0; cityRecords != NULL && i < cityCount; i++) {
+        memcpy(cityRecords[i].name, cities[i].name, CITY_LENGTH);
+    }
+    
+    int ok = cityRecords != NULL &&
+             writeDataSection(file, &sections[3], SECTION_CITIES, cityRecords, sizeof(CityRecord), cityCount) &&
+             writeDataSection(file, &sections[0], SECTION_ROUTES, routes, sizeof(Route), routeCount) &&
+             writeDataSection(file, &sections[1], SECTION_BOOKINGS, bookings, sizeof(Booking), bookingHighWater) &&
+             writeDataSection(file, &sections[2], SECTION_PAYMENTS, payments, sizeof(Payment), paymentCount);
+    free(cityRecords);
+    
+    memcpy(header.magic, DATA_FILE_MAGIC, sizeof(header.magic));
+    header.version = DATA_FILE_VERSION;
+    header.endianMark = DATA_FILE_ENDIAN_MARK;
+    header.sectionCount = SECTION_COUNT;
+    header.fileSize = (uint64_t)ftell(file);
+    header.journalSequence = journalSequence;
+    header.headerChecksum = crc32Update(crc32Update(0, &header, sizeof(header)), sections, sizeof(sections));
+    
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(sections, sizeof(sections), 1, file) == 1 &&
+         fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    
+    if(ok && rename(tmpPath, routesDataPath) == 0) {
+        checkpointSequence = journalSequence;
+    } else {
+        printf("Unable to save routes data!\n");
+        METRIC_FAILED();
+    }
+}
+
+int writeDataSection(FILE *file, DataSection *section, int id, const void *data, size_t elementSize, int count) {
+    static const char padding[DATA_SECTION_ALIGN] = {0};
+    long offset = ftell(file);
+    long aligned = (offset + DATA_SECTION_ALIGN - 1) / DATA_SECTION_ALIGN * DATA_SECTION_ALIGN;
+    
+    if(aligned > offset && fwrite(padding, aligned - offset, 1, file) != 1) return 0;
+    
+    section->id = (uint32_t)id;
+    section->elementSize = (uint32_t)elementSize;
+    section->offset = (uint64_t)aligned;
+    section->count = (uint64_t)count;
+    section->checksum = crc32Update(0, data, elementSize * count);
+    
+    return count == 0 || fwrite(data, elementSize, count, file) == (size_t)count;
+}
+
+// The file is mapped copy-on-write and the routes, bookings and payments
+// tables point straight into it, so loading costs one checksum pass rather
+// than a read and copy. growTable moves a table onto the heap the first time
+// it has to grow, and the mapping is dropped once nothing points into it.
+void loadRoutesData() {
+    int fd = open(routesDataPath, O_RDONLY);
+    if(fd == -1) return;
+    
+    METRIC_SCOPE(METRIC_LOAD);
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(DataFileHeader) + sizeof(DataSection) * SECTION_COUNT) {
+        close(fd);
+        rejectDataFile("file is truncated");
+        METRIC_FAILED();
+        return;
+    }
+    
+    void *map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        printf("Unable to map routes data!\n");
+        METRIC_FAILED();
+        return;
+    }
+    
+    DataFileHeader header;
+    memcpy(&header, map, sizeof(header));
+    DataSection *sections = (DataSection *)((char *)map + sizeof(DataFileHeader));
+    
+    const char *problem = NULL;
+    uint32_t headerChecksum = header.headerChecksum;
+    header.headerChecksum = 0;
+    
+    if(memcmp(header.magic, DATA_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        problem = "unrecognized format";
+    } else if(header.endianMark != DATA_FILE_ENDIAN_MARK) {
+        problem = "written on a machine with different byte order";
+    } else if(header.version != DATA_FILE_VERSION) {
+        problem = "unsupported format version";
+    } else if(header.sectionCount != SECTION_COUNT || header.fileSize != (uint64_t)info.st_size ||
+              crc32Update(crc32Update(0, &header, sizeof(header)), sections, sizeof(DataSection) * SECTION_COUNT) != headerChecksum) {
+        problem = "header is corrupt";
+    }
+    
+    // A previous load may still be mapped; it is released once the tables
+    // have moved over to the new file.
+    void *previousMap = dataFileMap;
+    size_t previousMapSize = dataFileMapSize;
+    dataFileMap = map;
+    dataFileMapSize = info.st_size;
+    
+    uint64_t storedRoutes = 0;
+    uint64_t storedBookings = 0;
+    uint64_t storedPayments = 0;
+    uint64_t storedCities = 0;
+    const void *cityData = NULL;
+    const void *routeData = NULL;
+    const void *bookingData = NULL;
+    const void *paymentData = NULL;
+    
+    if(problem == NULL) {
+        routeData = mapDataSection(&header, sections, SECTION_ROUTES, sizeof(Route), &storedRoutes);
+        bookingData = mapDataSection(&header, sections, SECTION_BOOKINGS, sizeof(Booking), &storedBookings);
+        paymentData = mapDataSection(&header, sections, SECTION_PAYMENTS, sizeof(Payment), &storedPayments);
+        cityData = mapDataSection(&header, sections, SECTION_CITIES, sizeof(CityRecord), &storedCities);
+        if(routeData == NULL || bookingData == NULL || paymentData == NULL || cityData == NULL) {
+            problem = "section is corrupt";
+        }
+    }
+    for(uint64_t i = 0; problem == NULL && i < storedRoutes; i++) {
+        const Route *route = (const Route *)routeData + i;
+        if(route->sourceCity < 0 || (uint64_t)route->sourceCity >= storedCities ||
+           route->destinationCity < 0 || (uint64_t)route->destinationCity >= storedCities) {
+            problem = "route refers to an unknown city";
+        } else if(route->departureMinute < 0 || route->departureMinute >= MINUTES_PER_DAY ||
+                  route->durationMinutes < 1 || route->durationMinutes > MINUTES_PER_DAY) {
+            problem = "route has an invalid departure time";
+        } else if(route->capacity < 1 || route->capacity > MAX_SEATS_PER_ROUTE) {
+            problem = "route has an invalid capacity";
+        }
+    }
+    // Free slots keep whatever they last held, so only live bookings are
+    // checked; their seats and payments are used as indexes.
+    for(uint64_t i = 0; problem == NULL && i < storedBookings; i++) {
+        const Booking *booking = (const Booking *)bookingData + i;
+        if(!booking->isBooked) continue;
+        if(booking->routeID < 0 || (uint64_t)booking->routeID >= storedRoutes ||
+           booking->seatNo < 1 || booking->seatNo > ((const Route *)routeData)[booking->routeID].capacity) {
+            problem = "booking refers to an unknown seat";
+        } else if(booking->paymentID < -1 || booking->paymentID >= (int64_t)storedPayments) {
+            problem = "booking refers to an unknown payment";
+        }
+    }
+    
+    if(problem != NULL) {
+        munmap(map, info.st_size);
+        dataFileMap = previousMap;
+        dataFileMapSize = previousMapSize;
+        rejectDataFile(problem);
+        METRIC_FAILED();
+        return;
+    }
+    
+    for(int i = 0; i < routeCount; i++) {
+        free(seatOwners[i]);
+    }
+    int **owners = realloc(seatOwners, sizeof(int *) * (storedRoutes > 0 ? storedRoutes : 1));
+    if(owners == NULL) {
+        printf("Unable to allocate route table!\n");
+        exit(1);
+    }
+    memset(owners, 0, sizeof(int *) * (storedRoutes > 0 ? storedRoutes : 1));
+    seatOwners = owners;
+    
+    if(!routesMapped) free(routes);
+    if(!bookingsMapped) free(bookings);
+    if(!paymentsMapped) free(payments);
+    
+    routes = (Route *)routeData;
+    routeCount = routeCapacity = (int)storedRoutes;
+    bookings = (Booking *)bookingData;
+    bookingCapacity = (int)storedBookings;
+    payments = (Payment *)paymentData;
+    paymentCount = paymentCapacity = (int)storedPayments;
+    routesMapped = bookingsMapped = paymentsMapped = 1;
+    if(previousMap != NULL) {
+        munmap(previousMap, previousMapSize);
+    }
+    
+    checkpointSequence = journalSequence = header.journalSequence;
+    loadCities((const CityRecord *)cityData, (int)storedCities);
+    rebuildIndexes();
+}
+
+const void *mapDataSection(DataFileHeader *header, DataSection *sections, int id, size_t elementSize, uint64_t *count) {
+    for(uint32_t i = 0; i < header->sectionCount; i++) {
+        DataSection *section = &sections[i];
+        if(section->id != (uint32_t)id) continue;
+        
+        if(section->elementSize != elementSize || section->offset % DATA_SECTION_ALIGN != 0 ||
+           section->count > (uint64_t)INT32_MAX ||
+           section->offset > header->fileSize ||
+           section->count * elementSize > header->fileSize - section->offset) {
+            return NULL;
+        }
+        
+        const void *data = (const char *)dataFileMap + section->offset;
+        if(crc32Update(0, data, section->count * elementSize) != section->checksum) {
+            return NULL;
+        }
+        *count = section->count;
+        return data;
+    }
+    return NULL;
+}
+
+// An unreadable routes.dat is set aside rather than overwritten by the next save.
+void rejectDataFile(const char reason[]) {
+    char rejectedPath[PATH_LENGTH];
+    snprintf(rejectedPath, sizeof(rejectedPath), "%s.rejected", routesDataPath);
+    
+    printf("%s could not be loaded (%s); it was renamed to %s.\n", routesDataPath, reason, rejectedPath);
+    rename(routesDataPath, rejectedPath);
+}
+
+void *growTable(void *table, int *mapped, size_t usedBytes, size_t newBytes) {
+    if(!*mapped) {
+        return realloc(table, newBytes);
+    }
+    
+    void *copy = malloc(newBytes);
+    if(copy == NULL) return NULL;
+    
+    memcpy(copy, table, usedBytes);
+    *mapped = 0;
+    releaseDataFileMap();
+    return copy;
+}
+
+void releaseDataFileMap() {
+    if(dataFileMap != NULL && !routesMapped && !bookingsMapped && !paymentsMapped) {
+        munmap(dataFileMap, dataFileMapSize);
+        dataFileMap = NULL;
+        dataFileMapSize = 0;
+    }
+}
+
+void rebuildIndexes() {
+    rebuildBookingColumns();
+    bookedSeats = countLiveBookings();
+    
+    rebuildBookingFreeList();
+    rebuildPhoneIndex();
+    rebuildSeatOwners();
+    resetHolds();
+    rebuildRouteIndex();
+    rebuildConnections();
+    rebuildDestinationIndex();
+    rebuildTransactionFloor();
+}
+
+uint32_t crc32Table[256];
+pthread_once_t crc32TableOnce = PTHREAD_ONCE_INIT;
+
+void initCrc32Table() {
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t value = i;
+        for(int bit = 0; bit < 8; bit++) {
+            value = (value >> 1) ^ (0xEDB88320u & (0u - (value & 1u)));
+        }
+        crc32Table[i] = value;
+    }
+}
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&crc32TableOnce, initCrc32Table);
+    
+    const unsigned char *bytes = data;
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ crc32Table[(crc ^ bytes[i]) & 0xFF];
+    }
+    return ~crc;
+}
+
+// journal.dat holds every change made since routes.dat was last written, as
+// checksummed after-images tagged with a sequence number. Records at or
+// below the sequence stored in routes.dat were already checkpointed and are
+// skipped, and replay stops at the first torn or corrupt record.
+void openJournal() {
+    journalFile = fopen(journalPath, "a+b");
+    if(journalFile == NULL) {
+        printf("Unable to open journal; changes will only be saved on exit.\n");
+        return;
+    }
+    setvbuf(journalFile, NULL, _IOFBF, 1 << 16);
+    
+    replayJournal();
+    clock_gettime(CLOCK_MONOTONIC, &journalLastSync);
+}
+
+void replayJournal() {
+    JournalHeader header;
+    void *payload = NULL;
+    size_t payloadCapacity = 0;
+    long goodOffset = 0;
+    int applied = 0;
+    
+    rewind(journalFile);
+    while(fread(&header, sizeof(header), 1, journalFile) == 1) {
+        if(header.magic != JOURNAL_MAGIC || header.length > (1u << 20)) break;
+        
+        if(header.length > payloadCapacity) {
+            void *grown = realloc(payload, header.length);
+            if(grown == NULL) break;
+            payload = grown;
+            payloadCapacity = header.length;
+        }
+        if(header.length > 0 && fread(payload, header.length, 1, journalFile) != 1) break;
+        
+        uint32_t checksum = header.checksum;
+        header.checksum = 0;
+        uint32_t actual = crc32Update(0, &header, sizeof(header));
+        actual = crc32Update(actual, payload, header.length);
+        if(actual != checksum) break;
+        
+        if(header.sequence > checkpointSequence) {
+            applyJournalRecord(&header, payload);
+            applied++;
+        }
+        if(header.sequence > journalSequence) {
+            journalSequence = header.sequence;
+        }
+        goodOffset = ftell(journalFile);
+    }
+    free(payload);
+    
+    fflush(journalFile);
+    if(ftruncate(fileno(journalFile), goodOffset) != 0) {
+        printf("Unable to trim journal!\n");
+    }
+    fseek(journalFile, 0, SEEK_END);
+    
+    if(applied > 0) {
+        rebuildIndexes();
+        journalRecordsSinceCheckpoint = applied;
+        printf("Recovered %d journaled change(s).\n", applied);
+    }
+}
+
+void applyJournalRecord(JournalHeader *header, const void *payload) {
+    int index = header->index;
+    if(index < 0) return;
+    
+    switch(header->type) {
+        case JOURNAL_ROUTE: {
+            const Route *route = payload;
+            if(header->length != sizeof(Route) || route->sourceCity < 0 || route->sourceCity >= cityCount ||
+               route->destinationCity < 0 || route->destinationCity >= cityCount ||
+               route->departureMinute < 0 || route->departureMinute >= MINUTES_PER_DAY ||
+               route->durationMinutes < 1 || route->durationMinutes > MINUTES_PER_DAY ||
+               route->capacity < 1 || route->capacity > MAX_SEATS_PER_ROUTE ||
+               !ensureRouteCapacity(index + 1)) {
+                return;
+            }
+            memcpy(&routes[index], payload, sizeof(Route));
+            if(index >= routeCount) routeCount = index + 1;
+            break;
+        }
+        case JOURNAL_BOOKING: {
+            // A seat outside its route would set a bit past the seat map.
+            const Booking *booking = payload;
+            if(header->length != sizeof(Booking) || booking->routeID < 0 || booking->routeID >= routeCount ||
+               booking->seatNo < 1 || booking->seatNo > routes[booking->routeID].capacity ||
+               !ensureBookingCapacity(index + 1)) {
+                return;
+            }
+            memcpy(&bookings[index], payload, sizeof(Booking));
+            markSeatBooked(&routes[bookings[index].routeID], bookings[index].seatNo);
+            break;
+        }
+        case JOURNAL_CANCEL:
+            if(index >= bookingCapacity || !bookings[index].isBooked ||
+               bookings[index].routeID < 0 || bookings[index].routeID >= routeCount ||
+               bookings[index].seatNo < 1 || bookings[index].seatNo > routes[bookings[index].routeID].capacity) {
+                return;
+            }
+            markSeatFree(&routes[bookings[index].routeID], bookings[index].seatNo);
+            bookings[index].isBooked = 0;
+            break;
+        case JOURNAL_CITY:
+            // Ids are dense, so only the next id can be new; earlier ones
+            // were already in the data file.
+            if(header->length != sizeof(CityRecord) || index != cityCount) return;
+            addCity(((const CityRecord *)payload)->name);
+            break;
+        case JOURNAL_PAYMENT:
+            if(header->length != sizeof(Payment) || !ensurePaymentCapacity(index + 1)) return;
+            memcpy(&payments[index], payload, sizeof(Payment));
+            if(index >= paymentCount) paymentCount = index + 1;
+            break;
+    }
+}
+
+void journalAppend(int type, int index, const void *payload, size_t length) {
+    if(journalFile == NULL) return;
+    
+    pthread_mutex_lock(&journalLock);
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.type = (uint16_t)type;
+    header.length = (uint32_t)length;
+    header.index = index;
+    header.sequence = ++journalSequence;
+    header.checksum = crc32Update(crc32Update(0, &header, sizeof(header)), payload, length);
+    
+    fwrite(&header, sizeof(header), 1, journalFile);
+    if(length > 0) {
+        fwrite(payload, length, 1, journalFile);
+    }
+    journalPendingSync++;
+    journalRecordsSinceCheckpoint++;
+    pthread_mutex_unlock(&journalLock);
+}
+
+// Called once per completed operation. Each commit reaches the kernel, so a
+// crashed process loses nothing; fdatasync is batched across up to
+// JOURNAL_GROUP_COMMIT_RECORDS records or JOURNAL_GROUP_COMMIT_MS. A due
+// checkpoint is only flagged here and runs when the store lock is released.
+void journalCommit() {
+    if(journalFile == NULL) return;
+    
+    pthread_mutex_lock(&journalLock);
+    if(journalPendingSync == 0) {
+        pthread_mutex_unlock(&journalLock);
+        return;
+    }
+    
+    fflush(journalFile);
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsedMs = (now.tv_sec - journalLastSync.tv_sec) * 1000 +
+                     (now.tv_nsec - journalLastSync.tv_nsec) / 1000000;
+    
+    if(journalPendingSync >= journalGroupCommitRecords || elapsedMs >= JOURNAL_GROUP_COMMIT_MS) {
+        METRIC_SCOPE(METRIC_JOURNAL_SYNC);
+        fdatasync(fileno(journalFile));
+        journalPendingSync = 0;
+        journalLastSync = now;
+    }
+    // Also waiting until the journal outgrows the live bookings keeps bulk
+    // loads from rewriting routes.dat every few hundred bookings.
+    if(journalRecordsSinceCheckpoint >= JOURNAL_CHECKPOINT_RECORDS &&
+       journalRecordsSinceCheckpoint >= __atomic_load_n(&bookedSeats, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&checkpointDue, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&journalLock);
+}
+
+void journalSync() {
+    if(journalFile == NULL) return;
+    
+    pthread_mutex_lock(&journalLock);
+    METRIC_SCOPE(METRIC_JOURNAL_SYNC);
+    fflush(journalFile);
+    fdatasync(fileno(journalFile));
+    journalPendingSync = 0;
+    clock_gettime(CLOCK_MONOTONIC, &journalLastSync);
+    pthread_mutex_unlock(&journalLock);
+}
+
+// Needs storeLock exclusively (or a single-threaded caller).
+void checkpointJournal() {
+    journalSync();
+    saveRoutesData();
+    
+    if(journalFile != NULL && checkpointSequence == journalSequence) {
+        if(ftruncate(fileno(journalFile), 0) == 0) {
+            fseek(journalFile, 0, SEEK_END);
+            journalRecordsSinceCheckpoint = 0;
+        }
+    }
+    __atomic_store_n(&checkpointDue, 0, __ATOMIC_RELEASE);
+}
+
+void outputPrintf(OutputBuffer *out, const char *format, ...) {
+    while(1) {
+        size_t room = out->capacity - out->length;
+        va_list args;
+        va_start(args, format);
+        int written = room > 0 ? vsnprintf(out->data + out->length, room, format, args) : -1;
+        va_end(args);
+        
+        if(written >= 0 && (size_t)written < room) {
+            out->length += written;
+            return;
+        }
+        
+        size_t newCapacity = out->capacity > 0 ? out->capacity * 2 : 4096;
+        while(written >= 0 && newCapacity - out->length <= (size_t)written) {
+            newCapacity *= 2;
+        }
+        char *grown = realloc(out->data, newCapacity);
+        if(grown == NULL) return;
+        out->data = grown;
+        out->capacity = newCapacity;
+    }
+}
+
+int splitFields(char line[], char *fields[], int maxFields) {
+    int count = 0;
+    char *start = line;
+    
+    while(count < maxFields) {
+        char *bar = strchr(start, '|');
+        if(bar != NULL) *bar = 0;
+        
+        while(isspace((unsigned char)*start)) start++;
+        char *end = start + strlen(start);
+        while(end > start && isspace((unsigned char)end[-1])) *--end = 0;
+        
+        fields[count++] = start;
+        if(bar == NULL) break;
+        start = bar + 1;
+    }
+    return count;
+}
+
+int parsePaymentChoice(const char text[]) {
+    for(int method = 0; method < PAYMENT_METHOD_COUNT; method++) {
+        if(strcasecmp(text, paymentMethods[method].name) == 0) return method + 1;
+    }
+    int choice = atoi(text);
+    return choice >= 1 && choice <= PAYMENT_METHOD_COUNT ? choice : 0;
+}
+
+void outputBookingMatch(OutputBuffer *out, int bookingIndex) {
+    Booking *booking = &bookings[bookingIndex];
+    Route *route = &routes[booking->routeID];
+    
+    outputPrintf(out, "MATCH|%d|%s|%s|%d|%s|%s|" DEPARTURE_FORMAT, bookingIndex, booking->name, booking->phone,
+                 booking->seatNo, cityName(route->sourceCity), cityName(route->destinationCity),
+                 DEPARTURE_ARGS(route->departureMinute));
+    if(booking->paymentID != -1) {
+        Payment *payment = &payments[booking->paymentID];
+        char transaction[TRANSACTION_ID_LENGTH];
+        outputPrintf(out, "|%s|%s|" MONEY_FORMAT, paymentMethods[payment->method].name,
+                     formatTransactionID(payment->transactionID, transaction), MONEY_ARGS(payment->totalPaid));
+    }
+    outputPrintf(out, "\n");
+}
+
+// Batch commands are one per line, fields separated by '|':
+//   book|source|destination|seat|name|phone|method
+//   cancel|source|destination|seat
+//   edit|source|destination|seat|name|phone
+//   search|phone|number   or   search|destination|name
+//   seats|source|destination
+//   set-time|source|destination|HH:MM
+//   set-duration|source|destination|minutes
+//   set-capacity|source|destination|seats
+//   add-departure|source|destination|HH:MM[|minutes]
+//   next|source|destination|HH:MM|seats   (first departure at or after HH:MM)
+//   group|source|destination|count|name|phone|method   (seats as n,n,...)
+//   hold|source|destination|seat[|seconds]   (answers with a hold token)
+//   confirm|token|name|phone|method
+//   release|token
+//   journey|source|destination|HH:MM|seats|earliest   or   ...|fewest
+//   metrics
+//   settle
+//   signup|username|password
+//   login|username|password         (answers with a session token)
+//   resume|username|token
+// Each command answers with "OK|..." or "ERR|message"; searches first emit
+// one "MATCH|..." line per booking and journeys one "LEG|..." line per bus.
+// Blank lines and '#' comments are skipped.
+// Returns 1 for a successful command, 0 otherwise.
+int executeCommand(char line[], OutputBuffer *out) {
+    char *fields[BATCH_MAX_FIELDS];
+    int count = splitFields(line, fields, BATCH_MAX_FIELDS);
+    const char *command = fields[0];
+    
+    if(strcmp(command, "book") == 0 && count == 7) {
+        int created;
+        int routeIndex = lookupOrCreateRoute(fields[1], fields[2], &created);
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|route unavailable\n");
+            return 0;
+        }
+        
+        int paymentChoice = parsePaymentChoice(fields[6]);
+        if(paymentChoice == 0) {
+            outputPrintf(out, "ERR|unknown payment method %s\n", fields[6]);
+            return 0;
+        }
+        
+        int bookingIndex = bookSeat(routeIndex, atoi(fields[3]), fields[4], fields[5], paymentChoice);
+        if(bookingIndex == BOOK_INVALID_SEAT) {
+            outputPrintf(out, "ERR|invalid seat %s\n", fields[3]);
+        } else if(bookingIndex == BOOK_SEAT_TAKEN) {
+            outputPrintf(out, "ERR|seat %s already booked\n", fields[3]);
+        } else if(bookingIndex < 0) {
+            outputPrintf(out, "ERR|booking table full\n");
+        } else {
+            acquireStoreShared();
+            int paymentID = bookings[bookingIndex].paymentID;
+            char transaction[TRANSACTION_ID_LENGTH];
+            outputPrintf(out, "OK|book|%d|%d|%s|" MONEY_FORMAT "\n", bookingIndex, routeIndex,
+                         formatTransactionID(payments[paymentID].transactionID, transaction),
+                         MONEY_ARGS(payments[paymentID].totalPaid));
+            releaseStore();
+            return 1;
+        }
+        return 0;
+    }
+    
+    if((strcmp(command, "cancel") == 0 && count == 4) || (strcmp(command, "edit") == 0 && count == 6)) {
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        releaseStore();
+        
+        int bookingIndex = -1;
+        if(routeIndex != -1) {
+            bookingIndex = command[0] == 'c' ? cancelSeat(routeIndex, atoi(fields[3]))
+                                             : updateSeatDetails(routeIndex, atoi(fields[3]), fields[4], fields[5]);
+        }
+        if(bookingIndex == -1) {
+            outputPrintf(out, "ERR|no booking for seat %s on %s to %s\n", fields[3], fields[1], fields[2]);
+            return 0;
+        }
+        outputPrintf(out, "OK|%s|%d\n", command, bookingIndex);
+        return 1;
+    }
+    
+    if(strcmp(command, "search") == 0 && count == 3) {
+        int matches = 0;
+        
+        acquireStoreShared();
+        if(strcmp(fields[1], "phone") == 0) {
+            METRIC_SCOPE(METRIC_SEARCH_PHONE);
+            pthread_mutex_lock(&phoneIndexLock);
+            for(int i = firstBookingForPhone(fields[2]); i != -1; i = bookings[i].nextSamePhone) {
+                outputBookingMatch(out, i);
+                matches++;
+            }
+            pthread_mutex_unlock(&phoneIndexLock);
+        } else if(strcmp(fields[1], "destination") == 0) {
+            METRIC_SCOPE(METRIC_SEARCH_DESTINATION);
+            int id = findDestination(fields[2]);
+            for(int r = 0; id != -1 && r < cities[id].routeListCount; r++) {
+                int routeIndex = cities[id].routeList[r];
+                pthread_mutex_lock(routeLock(routeIndex));
+                for(int seat = 1; seat <= routes[routeIndex].capacity; seat++) {
+                    int bookingIndex = seatBooking(routeIndex, seat);
+                    if(bookingIndex != -1) {
+                        outputBookingMatch(out, bookingIndex);
+                        matches++;
+                    }
+                }
+                pthread_mutex_unlock(routeLock(routeIndex));
+            }
+        } else {
+            releaseStore();
+            outputPrintf(out, "ERR|search by phone or destination\n");
+            return 0;
+        }
+        releaseStore();
+        outputPrintf(out, "OK|search|%d\n", matches);
+        return 1;
+    }
+    
+    if(strcmp(command, "seats") == 0 && count == 3) {
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        if(routeIndex == -1) {
+            releaseStore();
+            outputPrintf(out, "ERR|no route %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        
+        Route *route = &routes[routeIndex];
+        outputPrintf(out, "OK|seats|%d|" DEPARTURE_FORMAT "|%d|%d|", routeIndex,
+                     DEPARTURE_ARGS(route->departureMinute), freeSeatCount(route), route->capacity);
+        const char *separator = "";
+        for(int seat = nextFreeSeat(route, 1); seat != 0; seat = nextFreeSeat(route, seat + 1)) {
+            outputPrintf(out, "%s%d", separator, seat);
+            separator = ",";
+        }
+        outputPrintf(out, "\n");
+        releaseStore();
+        return 1;
+    }
+    
+    if(strcmp(command, "set-time") == 0 && count == 4) {
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        releaseStore();
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|no route %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        int departureMinute = parseDepartureTime(fields[3]);
+        if(departureMinute == -1 || !setRouteDeparture(routeIndex, departureMinute)) {
+            outputPrintf(out, "ERR|invalid time %s\n", fields[3]);
+            return 0;
+        }
+        outputPrintf(out, "OK|set-time|%d|" DEPARTURE_FORMAT "\n", routeIndex, DEPARTURE_ARGS(departureMinute));
+        return 1;
+    }
+    
+    if(strcmp(command, "set-duration") == 0 && count == 4) {
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        releaseStore();
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|no route %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        if(!setRouteDuration(routeIndex, atoi(fields[3]))) {
+            outputPrintf(out, "ERR|invalid duration %s\n", fields[3]);
+            return 0;
+        }
+        outputPrintf(out, "OK|set-duration|%d|%d\n", routeIndex, atoi(fields[3]));
+        return 1;
+    }
+    
+    if(strcmp(command, "set-capacity") == 0 && count == 4) {
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        releaseStore();
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|no route %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        int result = setRouteCapacity(routeIndex, atoi(fields[3]));
+        if(result < 0) {
+            outputPrintf(out, "ERR|seat %d is booked\n", -result);
+            return 0;
+        }
+        if(result == 0) {
+            outputPrintf(out, "ERR|invalid capacity %s\n", fields[3]);
+            return 0;
+        }
+        outputPrintf(out, "OK|set-capacity|%d|%d\n", routeIndex, atoi(fields[3]));
+        return 1;
+    }
+    
+    if(strcmp(command, "add-departure") == 0 && (count == 4 || count == 5)) {
+        int departureMinute = parseDepartureTime(fields[3]);
+        int durationMinutes = count == 5 ? atoi(fields[4]) : DEFAULT_TRIP_MINUTES;
+        if(departureMinute == -1) {
+            outputPrintf(out, "ERR|invalid time %s\n", fields[3]);
+            return 0;
+        }
+        if(durationMinutes < 1 || durationMinutes > MINUTES_PER_DAY) {
+            outputPrintf(out, "ERR|invalid duration %s\n", fields[4]);
+            return 0;
+        }
+        int routeIndex = addDeparture(fields[1], fields[2], departureMinute, durationMinutes);
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|route unavailable\n");
+            return 0;
+        }
+        outputPrintf(out, "OK|add-departure|%d|" DEPARTURE_FORMAT "\n", routeIndex, DEPARTURE_ARGS(departureMinute));
+        return 1;
+    }
+    
+    if(strcmp(command, "next") == 0 && count == 5) {
+        int departureMinute = parseDepartureTime(fields[3]);
+        if(departureMinute == -1) {
+            outputPrintf(out, "ERR|invalid time %s\n", fields[3]);
+            return 0;
+        }
+        
+        acquireStoreShared();
+        int sourceCity = findCity(fields[1]);
+        int destinationCity = findCity(fields[2]);
+        int corridor = sourceCity != -1 && destinationCity != -1 ? findCorridor(sourceCity, destinationCity) : -1;
+        int routeIndex = nextDeparture(corridor, departureMinute, atoi(fields[4]));
+        if(routeIndex == -1) {
+            releaseStore();
+            outputPrintf(out, "ERR|no departure from %s to %s at or after %s with %s seats\n",
+                         fields[1], fields[2], fields[3], fields[4]);
+            return 0;
+        }
+        outputPrintf(out, "OK|next|%d|" DEPARTURE_FORMAT "|%d\n", routeIndex,
+                     DEPARTURE_ARGS(routes[routeIndex].departureMinute), freeSeatCount(&routes[routeIndex]));
+        releaseStore();
+        return 1;
+    }
+    
+    if(strcmp(command, "journey") == 0 && count == 6) {
+        int minute = parseDepartureTime(fields[3]);
+        int mode = strcmp(fields[5], "fewest") == 0 ? JOURNEY_FEWEST_TRANSFERS : JOURNEY_EARLIEST_ARRIVAL;
+        if(minute == -1) {
+            outputPrintf(out, "ERR|invalid time %s\n", fields[3]);
+            return 0;
+        }
+        if(mode == JOURNEY_EARLIEST_ARRIVAL && strcmp(fields[5], "earliest") != 0) {
+            outputPrintf(out, "ERR|journey mode is earliest or fewest\n");
+            return 0;
+        }
+        
+        JourneyLeg legs[MAX_JOURNEY_LEGS];
+        int legCount;
+        char departs[JOURNEY_TIME_LENGTH], arrives[JOURNEY_TIME_LENGTH];
+        acquireStoreShared();
+        int arrival = planJourney(findCity(fields[1]), findCity(fields[2]), minute,
+                                  atoi(fields[4]) > 0 ? atoi(fields[4]) : 1, mode, legs, &legCount);
+        for(int i = 0; i < legCount; i++) {
+            Route *route = &routes[legs[i].routeIndex];
+            outputPrintf(out, "LEG|%d|%d|%s|%s|%s|%s|%d\n", i + 1, legs[i].routeIndex,
+                         cityName(route->sourceCity), cityName(route->destinationCity),
+                         formatJourneyTime(legs[i].departure, departs),
+                         formatJourneyTime(legs[i].arrival, arrives), freeSeatCount(route));
+        }
+        releaseStore();
+        
+        if(arrival == -1) {
+            outputPrintf(out, "ERR|no journey from %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        outputPrintf(out, "OK|journey|%d|%s|%s\n", legCount,
+                     formatJourneyTime(legs[0].departure, departs), formatJourneyTime(arrival, arrives));
+        return 1;
+    }
+    
+    if(strcmp(command, "group") == 0 && count == 7) {
+        int created;
+        int routeIndex = lookupOrCreateRoute(fields[1], fields[2], &created);
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|route unavailable\n");
+            return 0;
+        }
+        
+        int paymentChoice = parsePaymentChoice(fields[6]);
+        if(paymentChoice == 0) {
+            outputPrintf(out, "ERR|unknown payment method %s\n", fields[6]);
+            return 0;
+        }
+        
+        int bookingIndexes[MAX_SEATS_PER_ROUTE];
+        int seats = atoi(fields[3]);
+        int booked = seats >= 1 && seats <= MAX_SEATS_PER_ROUTE
+                   ? bookGroup(routeIndex, seats, fields[4], fields[5], paymentChoice, bookingIndexes)
+                   : BOOK_INVALID_SEAT;
+        if(booked == BOOK_INVALID_SEAT) {
+            outputPrintf(out, "ERR|invalid group size %s\n", fields[3]);
+        } else if(booked == BOOK_SEAT_TAKEN) {
+            outputPrintf(out, "ERR|fewer than %s seats free\n", fields[3]);
+        } else if(booked < 0) {
+            outputPrintf(out, "ERR|booking table full\n");
+        } else {
+            acquireStoreShared();
+            outputPrintf(out, "OK|group|%d|%d|", routeIndex, booked);
+            for(int i = 0; i < booked; i++) {
+                outputPrintf(out, "%s%d", i > 0 ? "," : "", bookings[bookingIndexes[i]].seatNo);
+            }
+            int paymentID = bookings[bookingIndexes[0]].paymentID;
+            char transaction[TRANSACTION_ID_LENGTH];
+            outputPrintf(out, "|%s|" MONEY_FORMAT "\n", formatTransactionID(payments[paymentID].transactionID, transaction),
+                         MONEY_ARGS(payments[paymentID].totalPaid));
+            releaseStore();
+            return 1;
+        }
+        return 0;
+    }
+    
+    if(strcmp(command, "hold") == 0 && (count == 4 || count == 5)) {
+        int seconds = count == 5 ? atoi(fields[4]) : HOLD_DEFAULT_SECONDS;
+        if(seconds < 1 || seconds > HOLD_MAX_SECONDS) {
+            outputPrintf(out, "ERR|hold seconds must be 1-%d\n", HOLD_MAX_SECONDS);
+            return 0;
+        }
+        
+        acquireStoreShared();
+        int routeIndex = findRoute(fields[1], fields[2]);
+        releaseStore();
+        if(routeIndex == -1) {
+            outputPrintf(out, "ERR|no route from %s to %s\n", fields[1], fields[2]);
+            return 0;
+        }
+        
+        int64_t token = holdSeat(routeIndex, atoi(fields[3]), seconds);
+        if(token == BOOK_INVALID_SEAT) {
+            outputPrintf(out, "ERR|invalid seat %s\n", fields[3]);
+        } else if(token == BOOK_SEAT_TAKEN) {
+            outputPrintf(out, "ERR|seat %s already booked\n", fields[3]);
+        } else if(token < 0) {
+            outputPrintf(out, "ERR|hold table full\n");
+        } else {
+            outputPrintf(out, "OK|hold|%lld|%d|%d|%d\n", (long long)token, routeIndex, atoi(fields[3]), seconds);
+            return 1;
+        }
+        return 0;
+    }
+    
+    if(strcmp(command, "confirm") == 0 && count == 5) {
+        int paymentChoice = parsePaymentChoice(fields[4]);
+        if(paymentChoice == 0) {
+            outputPrintf(out, "ERR|unknown payment method %s\n", fields[4]);
+            return 0;
+        }
+        
+        int bookingIndex = confirmHold(strtoll(fields[1], NULL, 10), fields[2], fields[3], paymentChoice);
+        if(bookingIndex == BOOK_HOLD_EXPIRED) {
+            outputPrintf(out, "ERR|no hold %s\n", fields[1]);
+        } else if(bookingIndex < 0) {
+            outputPrintf(out, "ERR|booking table full\n");
+        } else {
+            acquireStoreShared();
+            int paymentID = bookings[bookingIndex].paymentID;
+            char transaction[TRANSACTION_ID_LENGTH];
+            outputPrintf(out, "OK|confirm|%d|%d|%s|" MONEY_FORMAT "\n", bookingIndex, bookings[bookingIndex].routeID,
+                         formatTransactionID(payments[paymentID].transactionID, transaction),
+                         MONEY_ARGS(payments[paymentID].totalPaid));
+            releaseStore();
+            return 1;
+        }
+        return 0;
+    }
+    
+    if(strcmp(command, "release") == 0 && count == 2) {
+        if(!releaseHold(strtoll(fields[1], NULL, 10))) {
+            outputPrintf(out, "ERR|no hold %s\n", fields[1]);
+            return 0;
+        }
+        outputPrintf(out, "OK|release\n");
+        return 1;
+    }
+    
+    if(strcmp(command, "settle") == 0 && count == 1) {
+        PaymentSettlement totals[PAYMENT_METHOD_COUNT];
+        acquireStoreExclusive();
+        int mismatches = settlePayments(totals);
+        releaseStore();
+        
+        uint64_t settled = 0;
+        for(int method = 0; method < PAYMENT_METHOD_COUNT; method++) {
+            outputPrintf(out, "SETTLE|%s|%llu|" MONEY_FORMAT "|" MONEY_FORMAT "|" MONEY_FORMAT "\n",
+                         paymentMethods[method].name, (unsigned long long)totals[method].count,
+                         MONEY_ARGS(totals[method].amount), MONEY_ARGS(totals[method].fee),
+                         MONEY_ARGS(totals[method].totalPaid));
+            settled += totals[method].count;
+        }
+        outputPrintf(out, "OK|settle|%llu|%d\n", (unsigned long long)settled, mismatches);
+        return 1;
+    }
+    
+    if(strcmp(command, "signup") == 0 && count == 3) {
+        int userIndex = registerUser(fields[1], fields[2]);
+        if(userIndex == REGISTER_TAKEN) {
+            outputPrintf(out, "ERR|username %s already exists\n", fields[1]);
+        } else if(userIndex == REGISTER_INVALID) {
+            outputPrintf(out, "ERR|invalid username\n");
+        } else if(userIndex < 0) {
+            outputPrintf(out, "ERR|unable to register user\n");
+        } else {
+            outputPrintf(out, "OK|signup|%d\n", userIndex);
+            return 1;
+        }
+        return 0;
+    }
+    
+    if(strcmp(command, "login") == 0 && count == 3) {
+        uint8_t token[SESSION_TOKEN_LENGTH];
+        char tokenText[SESSION_TOKEN_TEXT_LENGTH];
+        int userIndex = authenticateUser(fields[1], fields[2], token);
+        if(userIndex == -1) {
+            outputPrintf(out, "ERR|invalid username or password\n");
+            return 0;
+        }
+        outputPrintf(out, "OK|login|%d|%s\n", userIndex, formatSessionToken(token, tokenText));
+        return 1;
+    }
+    
+    if(strcmp(command, "resume") == 0 && count == 3) {
+        int userIndex = resumeSession(fields[1], fields[2]);
+        if(userIndex == -1) {
+            outputPrintf(out, "ERR|no session\n");
+            return 0;
+        }
+        outputPrintf(out, "OK|resume|%d\n", userIndex);
+        return 1;
+    }
+    
+    if(strcmp(command, "metrics") == 0 && count == 1) {
+        int shown = outputMetrics(out);
+        if(shown < 0) {
+            outputPrintf(out, "ERR|metrics compiled out\n");
+            return 0;
+        }
+        outputPrintf(out, "OK|metrics|%d\n", shown);
+        return 1;
+    }
+    
+    outputPrintf(out, "ERR|unrecognized command\n");
+    return 0;
+}
+
+void runBatch(FILE *input) {
+    char line[BATCH_LINE_LENGTH];
+    OutputBuffer out = { NULL, 0, 0 };
+    long lineNumber = 0;
+    long succeeded = 0;
+    long failed = 0;
+    
+    journalGroupCommitRecords = BATCH_GROUP_COMMIT_RECORDS;
+    
+    while(fgets(line, sizeof(line), input) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = 0;
+        
+        char *start = line;
+        while(isspace((unsigned char)*start)) start++;
+        if(*start == 0 || *start == '#') continue;
+        
+        size_t responseStart = out.length;
+        if(executeCommand(start, &out)) {
+            succeeded++;
+        } else {
+            failed++;
+            fprintf(stderr, "line %ld: %.*s", lineNumber,
+                    (int)(out.length - responseStart), out.data + responseStart);
+        }
+        
+        if(out.length >= BATCH_FLUSH_BYTES) {
+            fwrite(out.data, 1, out.length, stdout);
+            out.length = 0;
+        }
+    }
+    
+    outputPrintf(&out, "DONE|%ld|%ld\n", succeeded, failed);
+    fwrite(out.data, 1, out.length, stdout);
+    fflush(stdout);
+    free(out.data);
+    
+    journalGroupCommitRecords = JOURNAL_GROUP_COMMIT_RECORDS;
+    journalSync();
+}
+
+int openTcpListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1) return -1;
+    
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    if(bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int openUnixListener(const char path[]) {
+    struct sockaddr_un address;
+    if(strlen(path) >= sizeof(address.sun_path)) return -1;
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1) return -1;
+    
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    
+    if(bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void handleStopSignal(int signalNumber) {
+    (void)signalNumber;
+    __atomic_store_n(&serverStopping, 1, __ATOMIC_RELAXED);
+}
+
+// Reading stops while a client has more than SERVER_OUTPUT_LIMIT of replies
+// waiting, so a client that never reads cannot grow its buffer without bound.
+void updateConnectionEvents(int epollFd, Connection *conn) {
+    size_t pending = conn->output.length - conn->outputSent;
+    uint32_t events = 0;
+    
+    if(pending > 0) events |= EPOLLOUT;
+    if(!conn->closing && pending < SERVER_OUTPUT_LIMIT) events |= EPOLLIN;
+    
+    if(events != conn->events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = conn;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+void closeConnection(int epollFd, Connection *conn) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->output.data);
+    free(conn->authOutput.data);
+    free(conn);
+}
+
+void acceptConnections(int epollFd, Connection *listener) {
+    while(1) {
+        int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1) return;
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        Connection *conn = calloc(1, sizeof(Connection));
+        if(conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->epollFd = epollFd;
+        conn->events = EPOLLIN;
+        
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+// Returns 0 once the peer has gone away.
+int flushConnection(Connection *conn) {
+    while(conn->outputSent < conn->output.length) {
+        ssize_t sent = send(conn->fd, conn->output.data + conn->outputSent,
+                            conn->output.length - conn->outputSent, MSG_NOSIGNAL);
+        if(sent == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        conn->outputSent += sent;
+    }
+    conn->output.length = 0;
+    conn->outputSent = 0;
+    return 1;
+}
+
+// Reads what the client has sent and runs each complete line through
+// runConnectionLines; a partial line waits in the buffer for more input.
+void readConnection(Connection *conn) {
+    while(!conn->closing && !conn->authPending) {
+        size_t room = sizeof(conn->input) - conn->inputLength;
+        ssize_t received = recv(conn->fd, conn->input + conn->inputLength, room, 0);
+        if(received == 0) {
+            conn->closing = 1;
+            break;
+        }
+        if(received == -1) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) conn->closing = 1;
+            break;
+        }
+        conn->inputLength += received;
+        
+        runConnectionLines(conn);
+        if(conn->output.length - conn->outputSent >= SERVER_OUTPUT_LIMIT) break;
+    }
+}
+
+// Runs the complete lines buffered for conn through executeCommand, queueing
+// the replies in order. A login or signup goes to an auth thread instead, and
+// the lines after it wait in the buffer until finishAuth has its reply.
+void runConnectionLines(Connection *conn) {
+    char *start = conn->input;
+    char *end = conn->input + conn->inputLength;
+    char *newline;
+    while(!conn->authPending && (newline = memchr(start, '\n', end - start)) != NULL) {
+        *newline = 0;
+        if(newline > start && newline[-1] == '\r') newline[-1] = 0;
+        
+        char *line = start;
+        while(isspace((unsigned char)*line)) line++;
+        if(*line != 0 && *line != '#' && !(isAuthCommand(line) && queueAuth(conn, line))) {
+            executeCommand(line, &conn->output);
+        }
+        start = newline + 1;
+    }
+    
+    conn->inputLength = end - start;
+    memmove(conn->input, start, conn->inputLength);
+    if(!conn->authPending && conn->inputLength == sizeof(conn->input)) {
+        outputPrintf(&conn->output, "ERR|line too long\n");
+        conn->closing = 1;
+    }
+}
+
+int isAuthCommand(const char line[]) {
+    size_t length = strcspn(line, "|");
+    while(length > 0 && isspace((unsigned char)line[length - 1])) length--;
+    return (length == 5 && strncmp(line, "login", 5) == 0) ||
+           (length == 6 && strncmp(line, "signup", 6) == 0);
+}
+
+// Hands a login or signup to the auth threads so its PBKDF2 work does not
+// stall every other connection on this worker. The connection leaves its
+// worker's epoll set until authWorker puts it back. Returns 0 if the queue
+// cannot grow, in which case the caller runs the line itself.
+int queueAuth(Connection *conn, const char line[]) {
+    pthread_mutex_lock(&authQueueLock);
+    if(authThreadCount == 0) {
+        pthread_mutex_unlock(&authQueueLock);
+        return 0;
+    }
+    if(authQueueCount == authQueueCapacity) {
+        int newCapacity = authQueueCapacity > 0 ? authQueueCapacity * 2 : SERVER_MAX_EVENTS;
+        Connection **grown = malloc(sizeof(Connection *) * newCapacity);
+        if(grown == NULL) {
+            pthread_mutex_unlock(&authQueueLock);
+            return 0;
+        }
+        for(int i = 0; i < authQueueCount; i++) {
+            grown[i] = authQueue[(authQueueHead + i) % authQueueCapacity];
+        }
+        free(authQueue);
+        authQueue = grown;
+        authQueueHead = 0;
+        authQueueCapacity = newCapacity;
+    }
+    
+    snprintf(conn->authLine, sizeof(conn->authLine), "%s", line);
+    conn->authPending = 1;
+    epoll_ctl(conn->epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    conn->events = 0;
+    authQueue[(authQueueHead + authQueueCount++) % authQueueCapacity] = conn;
+    pthread_cond_signal(&authQueueReady);
+    pthread_mutex_unlock(&authQueueLock);
+    return 1;
+}
+
+// Runs queued login and signup lines. Each reply goes to the connection's
+// authOutput and the connection is added back to its worker's epoll set,
+// where finishAuth picks the reply up; authDone publishes it.
+void *authWorker(void *arg) {
+    (void)arg;
+    
+    while(1) {
+        pthread_mutex_lock(&authQueueLock);
+        while(authQueueCount == 0 && !authStopping) {
+            pthread_cond_wait(&authQueueReady, &authQueueLock);
+        }
+        if(authStopping) {
+            pthread_mutex_unlock(&authQueueLock);
+            return NULL;
+        }
+        Connection *conn = authQueue[authQueueHead];
+        authQueueHead = (authQueueHead + 1) % authQueueCapacity;
+        authQueueCount--;
+        pthread_mutex_unlock(&authQueueLock);
+        
+        executeCommand(conn->authLine, &conn->authOutput);
+        
+        struct epoll_event event;
+        event.events = EPOLLOUT;
+        event.data.ptr = conn;
+        conn->events = EPOLLOUT;
+        __atomic_store_n(&conn->authDone, 1, __ATOMIC_RELEASE);
+        epoll_ctl(conn->epollFd, EPOLL_CTL_ADD, conn->fd, &event);
+    }
+}
+
+// Queues the reply an auth thread produced and runs the lines that arrived
+// after the login or signup.
+void finishAuth(Connection *conn) {
+    outputPrintf(&conn->output, "%.*s", (int)conn->authOutput.length, conn->authOutput.data);
+    conn->authOutput.length = 0;
+    conn->authDone = 0;
+    conn->authPending = 0;
+    runConnectionLines(conn);
+}
+
+void *serverWorker(void *arg) {
+    ServerWorker *worker = arg;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    struct timespec lastTick;
+    clock_gettime(CLOCK_MONOTONIC, &lastTick);
+    
+    while(!__atomic_load_n(&serverStopping, __ATOMIC_RELAXED)) {
+        int ready = epoll_wait(worker->epollFd, events, SERVER_MAX_EVENTS, SERVER_TICK_MS);
+        
+        for(int i = 0; i < ready; i++) {
+            Connection *conn = events[i].data.ptr;
+            if(conn->listening) {
+                acceptConnections(worker->epollFd, conn);
+                continue;
+            }
+            
+            if(conn->authPending && __atomic_load_n(&conn->authDone, __ATOMIC_ACQUIRE)) {
+                finishAuth(conn);
+            }
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readConnection(conn);
+            }
+            int open = flushConnection(conn);
+            if(conn->authPending) {
+                // An auth thread owns the connection's epoll registration
+                // until the reply is ready, so it is closed after that.
+                if(!open) conn->closing = 1;
+                continue;
+            }
+            if(!open || (conn->closing && conn->output.length == 0)) {
+                closeConnection(worker->epollFd, conn);
+                continue;
+            }
+            updateConnectionEvents(worker->epollFd, conn);
+        }
+        
+        // Expires holds and honours the group-commit time limit even when no
+        // command arrives, at most once per SERVER_TICK_MS so a busy worker
+        // does not pay for it on every batch of events.
+        if(worker->index == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if(ready == 0 || elapsedNanos(&lastTick, &now) >= SERVER_TICK_MS * 1000000ull) {
+                lastTick = now;
+                acquireStoreShared();
+                expireHolds();
+                journalCommit();
+                releaseStore();
+            }
+        }
+    }
+    return NULL;
+}
+
+// Serves the batch command protocol on 127.0.0.1:port and a Unix socket until
+// SIGINT or SIGTERM. Each worker thread runs its own epoll loop; both
+// listeners are shared with EPOLLEXCLUSIVE so a new client wakes one worker,
+// which then owns that connection for its lifetime. Logins and signups run on
+// SERVER_AUTH_THREADS separate threads; see queueAuth.
+int runServer(int port, const char socketPath[]) {
+    int tcpFd = port > 0 ? openTcpListener(port) : -1;
+    int unixFd = socketPath[0] != 0 ? openUnixListener(socketPath) : -1;
+    if(tcpFd == -1 && unixFd == -1) {
+        printf("Unable to open server sockets!\n");
+        return 1;
+    }
+    
+    serverListenerCount = 0;
+    if(tcpFd != -1) {
+        serverListeners[serverListenerCount].fd = tcpFd;
+        serverListeners[serverListenerCount++].listening = 1;
+    }
+    if(unixFd != -1) {
+        serverListeners[serverListenerCount].fd = unixFd;
+        serverListeners[serverListenerCount++].listening = 1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerCount = cpus < 1 ? 1 : cpus > SERVER_MAX_WORKERS ? SERVER_MAX_WORKERS : (int)cpus;
+    ServerWorker workers[SERVER_MAX_WORKERS];
+    int started = 0;
+    
+    pthread_t authThreads[SERVER_AUTH_THREADS];
+    authStopping = 0;
+    authThreadCount = 0;
+    for(int i = 0; i < SERVER_AUTH_THREADS; i++) {
+        if(pthread_create(&authThreads[i], NULL, authWorker, NULL) != 0) break;
+        authThreadCount++;
+    }
+    
+    for(int i = 0; i < workerCount; i++) {
+        workers[i].index = i;
+        workers[i].epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(workers[i].epollFd == -1) break;
+        
+        for(int l = 0; l < serverListenerCount; l++) {
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+            event.data.ptr = &serverListeners[l];
+            epoll_ctl(workers[i].epollFd, EPOLL_CTL_ADD, serverListeners[l].fd, &event);
+        }
+        if(pthread_create(&workers[i].thread, NULL, serverWorker, &workers[i]) != 0) {
+            close(workers[i].epollFd);
+            break;
+        }
+        started++;
+    }
+    
+    if(started == 0) {
+        printf("Unable to start server workers!\n");
+    } else {
+        if(tcpFd != -1) printf("Listening on 127.0.0.1:%d\n", port);
+        if(unixFd != -1) printf("Listening on %s\n", socketPath);
+        printf("Serving with %d worker(s); press Ctrl+C to stop.\n", started);
+        fflush(stdout);
+    }
+    
+    for(int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_mutex_lock(&authQueueLock);
+    authStopping = 1;
+    pthread_cond_broadcast(&authQueueReady);
+    pthread_mutex_unlock(&authQueueLock);
+    for(int i = 0; i < authThreadCount; i++) {
+        pthread_join(authThreads[i], NULL);
+    }
+    for(int i = 0; i < started; i++) {
+        close(workers[i].epollFd);
+    }
+    for(int l = 0; l < serverListenerCount; l++) {
+        close(serverListeners[l].fd);
+    }
+    if(unixFd != -1) unlink(socketPath);
+    return started == 0;
+}
+
+// address is "port", "host:port", or a Unix socket path.
+int connectToServer(const char address[]) {
+    const char *colon = strrchr(address, ':');
+    int numeric = address[0] != 0 && strspn(address, "0123456789") == strlen(address);
+    
+    if(colon == NULL && !numeric) {
+        struct sockaddr_un unixAddress;
+        if(strlen(address) >= sizeof(unixAddress.sun_path)) return -1;
+        
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd == -1) return -1;
+        memset(&unixAddress, 0, sizeof(unixAddress));
+        unixAddress.sun_family = AF_UNIX;
+        strcpy(unixAddress.sun_path, address);
+        if(connect(fd, (struct sockaddr *)&unixAddress, sizeof(unixAddress)) == -1) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    
+    char host[64] = "127.0.0.1";
+    int port = atoi(colon != NULL ? colon + 1 : address);
+    if(colon != NULL && colon > address && (size_t)(colon - address) < sizeof(host)) {
+        memcpy(host, address, colon - address);
+        host[colon - address] = 0;
+    }
+    
+    struct sockaddr_in tcpAddress;
+    memset(&tcpAddress, 0, sizeof(tcpAddress));
+    tcpAddress.sin_family = AF_INET;
+    tcpAddress.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &tcpAddress.sin_addr) != 1) return -1;
+    
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1) return -1;
+    if(connect(fd, (struct sockaddr *)&tcpAddress, sizeof(tcpAddress)) == -1) {
+        close(fd);
+        return -1;
+    }
+    
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Sends each command line from stdin and prints the reply, which ends at the
+// first OK| or ERR| line.
+int runClient(const char address[]) {
+    int fd = connectToServer(address);
+    if(fd == -1) {
+        fprintf(stderr, "Unable to connect to %s\n", address);
+        return 1;
+    }
+    
+    FILE *replies = fdopen(fd, "r");
+    if(replies == NULL) {
+        close(fd);
+        return 1;
+    }
+    
+    char line[BATCH_LINE_LENGTH];
+    char reply[BATCH_LINE_LENGTH * 4];
+    int failed = 0;
+    
+    while(fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\r\n")] = 0;
+        
+        char *start = line;
+        while(isspace((unsigned char)*start)) start++;
+        if(*start == 0 || *start == '#') continue;
+        
+        size_t length = strlen(start);
+        start[length++] = '\n';
+        if(send(fd, start, length, MSG_NOSIGNAL) != (ssize_t)length) {
+            fprintf(stderr, "Connection lost\n");
+            failed = 1;
+            break;
+        }
+        
+        int done = 0;
+        while(!done && fgets(reply, sizeof(reply), replies) != NULL) {
+            fputs(reply, stdout);
+            done = strncmp(reply, "OK|", 3) == 0 || strncmp(reply, "ERR|", 4) == 0;
+        }
+        if(!done) {
+            fprintf(stderr, "Connection lost\n");
+            failed = 1;
+            break;
+        }
+    }
+    
+    fclose(replies);
+    return failed;
+}
+
+void clearInputBuffer() {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF);
+}
+
+// Spreads iterations over [0, range) so consecutive operations touch
+// unrelated routes and bookings instead of walking memory in order.
+unsigned int benchPick(int iteration, int range) {
+    return (unsigned int)((uint64_t)(unsigned int)iteration * 2654435761u % (unsigned int)range);
+}
+
+void benchFindRoute(int iteration) {
+    int r = benchPick(iteration, benchRoutes);
+    benchSink += findRoute(benchSources[r], benchDestinations[r]);
+}
+
+void benchFindOrCreateRoute(int iteration) {
+    int r = benchPick(iteration, benchRoutes);
+    benchSink += findOrCreateRoute(benchSources[r], benchDestinations[r]);
+}
+
+void benchSeatAvailability(int iteration) {
+    Route *route = &routes[benchRouteIndexes[benchPick(iteration, benchRoutes)]];
+    benchSink += freeSeatCount(route);
+    for(int seat = nextFreeSeat(route, 1); seat != 0; seat = nextFreeSeat(route, seat + 1)) {
+        benchSink += seat;
+    }
+}
+
+void benchBookingSlot(int iteration) {
+    (void)iteration;
+    int bookingIndex = allocateBooking();
+    releaseBooking(bookingIndex);
+    benchSink += bookingIndex;
+}
+
+void benchBookAndCancel(int iteration) {
+    int routeIndex = benchRouteIndexes[benchPick(iteration, benchRoutes)];
+    int seat = nextFreeSeat(&routes[routeIndex], 1);
+    bookSeat(routeIndex, seat, "Bench Passenger", benchPhones[benchPick(iteration, benchBookings)], iteration % 5 + 1);
+    benchSink += cancelSeat(routeIndex, seat);
+}
+
+void benchSearchByPhone(int iteration) {
+    for(int i = firstBookingForPhone(benchPhones[benchPick(iteration, benchBookings)]); i != -1; i = bookings[i].nextSamePhone) {
+        benchSink += bookings[i].seatNo;
+    }
+}
+
+void benchSearchByDestination(int iteration) {
+    int id = findDestination(benchDestinations[benchPick(iteration, benchRoutes)]);
+    for(int r = 0; id != -1 && r < cities[id].routeListCount; r++) {
+        int routeIndex = cities[id].routeList[r];
+        for(int seat = 1; seat <= routes[routeIndex].capacity; seat++) {
+            benchSink += seatBooking(routeIndex, seat);
+        }
+    }
+}
+
+void benchDestinationHints(int iteration) {
+    int results[MAX_DESTINATION_HINTS];
+    char prefix[4];
+    snprintf(prefix, sizeof(prefix), "%s", benchDestinations[benchPick(iteration, benchRoutes)]);
+    benchSink += completeDestinations(prefix, results, MAX_DESTINATION_HINTS);
+}
+
+void benchTicketLookup(int iteration) {
+    int r = benchPick(iteration, benchRoutes);
+    benchSink += findBookingByDestinationSeat(benchDestinations[r], iteration % TOTAL_SEATS + 1);
+}
+
+void benchTransactionID(int iteration) {
+    (void)iteration;
+    benchSink += (long)nextTransactionID();
+}
+
+void benchSaveRoutesData(int iteration) {
+    (void)iteration;
+    saveRoutesData();
+}
+
+void benchLoadRoutesData(int iteration) {
+    (void)iteration;
+    loadRoutesData();
+    benchSink += routeCount;
+}
+
+void runBenchmark(const char name[], void (*operation)(int), int iterations) {
+    if(iterations < 1) iterations = 1;
+    for(int i = 0; i < iterations / 10; i++) {
+        operation(i);
+    }
+    
+#ifdef TTBS_BENCH
+    uint64_t allocationsBefore = __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+#endif
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0; i < iterations; i++) {
+        operation(i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    double elapsedNs = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+#ifdef TTBS_BENCH
+    uint64_t allocations = __atomic_load_n(&allocationCount, __ATOMIC_RELAXED) - allocationsBefore;
+    printf("%-26s %10d %14.1f %12.3f\n", name, iterations, elapsedNs / iterations, (double)allocations / iterations);
+#else
+    printf("%-26s %10d %14.1f %12s\n", name, iterations, elapsedNs / iterations, "-");
+#endif
+}
+
+// Builds routeTotal routes over about routeTotal / 4 destinations and books
+// bookingTotal seats across them, leaving at least one seat free per route.
+// Every phone number is shared by two bookings.
+int populateBenchData(int routeTotal, int bookingTotal) {
+    int destinationTotal = routeTotal / 4 > 0 ? routeTotal / 4 : 1;
+    
+    benchSources = malloc(sizeof(*benchSources) * routeTotal);
+    benchDestinations = malloc(sizeof(*benchDestinations) * routeTotal);
+    benchRouteIndexes = malloc(sizeof(int) * routeTotal);
+    benchPhones = malloc(sizeof(*benchPhones) * (bookingTotal > 0 ? bookingTotal : 1));
+    if(benchSources == NULL || benchDestinations == NULL || benchRouteIndexes == NULL || benchPhones == NULL) {
+        return 0;
+    }
+    
+    for(int r = 0; r < routeTotal; r++) {
+        int created;
+        snprintf(benchSources[r], SOURCE_LENGTH, "Origin%06d", r);
+        snprintf(benchDestinations[r], DESTINATION_LENGTH, "Town%06d", r % destinationTotal);
+        benchRouteIndexes[r] = lookupOrCreateRoute(benchSources[r], benchDestinations[r], &created);
+        if(benchRouteIndexes[r] == -1) return 0;
+    }
+    
+    for(int b = 0; b < bookingTotal; b++) {
+        int routeIndex = benchRouteIndexes[b % routeTotal];
+        snprintf(benchPhones[b], PHONE_LENGTH, "01%09d", b / 2);
+        if(bookSeat(routeIndex, b / routeTotal + 1, "Bench Passenger", benchPhones[b], b % 5 + 1) < 0) {
+            return 0;
+        }
+    }
+    
+    benchRoutes = routeTotal;
+    benchBookings = bookingTotal > 0 ? bookingTotal : 1;
+    if(bookingTotal == 0) strcpy(benchPhones[0], "0");
+    return 1;
+}
+
+// Runs every benchmark against a synthetic store built in memory; the real
+// data files and journal are never opened. Save and load use
+// BENCH_DATA_PATH and far fewer iterations, since each one moves the whole
+// store through the file system.
+int runBenchmarks(int routeTotal, int bookingTotal, int iterations) {
+    if(routeTotal < 1) routeTotal = 1;
+    if(bookingTotal < 0) bookingTotal = 0;
+    if(bookingTotal > routeTotal * (TOTAL_SEATS - 1)) {
+        bookingTotal = routeTotal * (TOTAL_SEATS - 1);
+    }
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(!populateBenchData(routeTotal, bookingTotal)) {
+        printf("Unable to build benchmark data!\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    printf("Benchmark store: %d routes, %d cities, %d bookings (built in %.1f ms)\n",
+           routeCount, cityCount, bookedSeats,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    printf("%-26s %10s %14s %12s\n", "operation", "ops", "ns/op", "allocs/op");
+    
+    runBenchmark("findRoute", benchFindRoute, iterations);
+    runBenchmark("findOrCreateRoute (hit)", benchFindOrCreateRoute, iterations);
+    runBenchmark("seat availability", benchSeatAvailability, iterations);
+    runBenchmark("search by phone", benchSearchByPhone, iterations);
+    runBenchmark("search by destination", benchSearchByDestination, iterations);
+    runBenchmark("destination hints", benchDestinationHints, iterations);
+    runBenchmark("printTicket lookup", benchTicketLookup, iterations);
+    runBenchmark("transaction id", benchTransactionID, iterations);
+    
+    // File round trips run before the booking benchmarks, whose payments
+    // would otherwise inflate the data file.
+    routesDataPath = BENCH_DATA_PATH;
+    int fileIterations = iterations / 10000 > 0 ? iterations / 10000 : 1;
+    runBenchmark("saveRoutesData", benchSaveRoutesData, fileIterations);
+    runBenchmark("loadRoutesData", benchLoadRoutesData, fileIterations);
+    
+    struct stat info;
+    if(stat(BENCH_DATA_PATH, &info) == 0) {
+        printf("%-26s %10s %14.1f KB\n", "data file size", "", info.st_size / 1024.0);
+    }
+    unlink(BENCH_DATA_PATH);
+    
+    runBenchmark("booking slot alloc+free", benchBookingSlot, iterations);
+    runBenchmark("bookSeat+cancelSeat", benchBookAndCancel, iterations);
+    return 0;
+}
+
+int latencyBucket(uint64_t ns) {
+    if(ns < (1u << LATENCY_SUB_BUCKET_BITS)) return (int)ns;
+    
+    int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BUCKET_BITS;
+    int step = (int)(ns >> shift) & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+    return ((shift + 1) << LATENCY_SUB_BUCKET_BITS) + step;
+}
+
+// Midpoint of the values that land in bucket.
+uint64_t latencyBucketValue(int bucket) {
+    if(bucket < (1 << LATENCY_SUB_BUCKET_BITS)) return bucket;
+    
+    int shift = (bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+    uint64_t step = bucket & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+    return (((1u << LATENCY_SUB_BUCKET_BITS) + step) << shift) + ((UINT64_C(1) << shift) >> 1);
+}
+
+void recordLatency(LatencyHistogram *histogram, uint64_t ns) {
+    histogram->counts[latencyBucket(ns)]++;
+    histogram->total++;
+    if(ns > histogram->maxNs) histogram->maxNs = ns;
+}
+
+void mergeLatency(LatencyHistogram *into, const LatencyHistogram *from) {
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if(from->maxNs > into->maxNs) into->maxNs = from->maxNs;
+}
+
+uint64_t latencyPercentile(const LatencyHistogram *histogram, double percentile) {
+    if(histogram->total == 0) return 0;
+    
+    uint64_t rank = (uint64_t)(histogram->total * percentile / 100.0 + 0.999999);
+    if(rank < 1) rank = 1;
+    
+    uint64_t seen = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if(seen >= rank) {
+            uint64_t value = latencyBucketValue(i);
+            return value < histogram->maxNs ? value : histogram->maxNs;
+        }
+    }
+    return histogram->maxNs;
+}
+
+uint64_t elapsedNanos(const struct timespec *from, const struct timespec *to) {
+    int64_t ns = (int64_t)(to->tv_sec - from->tv_sec) * 1000000000 + (to->tv_nsec - from->tv_nsec);
+    return ns > 0 ? (uint64_t)ns : 0;
+}
+
+// Squaring a uniform draw skews traffic toward the low-numbered routes, the
+// way a few popular corridors take most of a holiday rush.
+int loadPickRoute(unsigned int *seed) {
+    double draw = rand_r(seed) / ((double)RAND_MAX + 1.0);
+    return (int)(draw * draw * loadRoutes);
+}
+
+// Returns a booked seat found from a random starting point, or 0. Caller
+// holds storeLock shared.
+int loadPickBookedSeat(int routeIndex, unsigned int *seed) {
+    int capacity = routes[routeIndex].capacity;
+    int start = rand_r(seed) % capacity;
+    
+    for(int i = 0; i < capacity; i++) {
+        int seat = (start + i) % capacity + 1;
+        if(isSeatBooked(&routes[routeIndex], seat)) return seat;
+    }
+    return 0;
+}
+
+// Route lookup, seat pick, booking with payment, then the ticket read-back.
+// A seat taken between the pick and the claim counts as a conflict and is
+// retried with a fresh pick.
+int loadBook(LoadWorker *worker) {
+    int r = loadPickRoute(&worker->seed);
+    int created;
+    int routeIndex = lookupOrCreateRoute(loadSources[r], loadDestinations[r], &created);
+    if(routeIndex == -1) return 0;
+    
+    char name[NAME_LENGTH];
+    char phone[PHONE_LENGTH];
+    snprintf(name, sizeof(name), "Load Passenger %u", rand_r(&worker->seed) % 1000);
+    snprintf(phone, sizeof(phone), "017%08d", rand_r(&worker->seed) % LOADGEN_PHONE_RANGE);
+    
+    for(int attempt = 0; attempt < LOADGEN_BOOK_ATTEMPTS; attempt++) {
+        acquireStoreShared();
+        Route *route = &routes[routeIndex];
+        int seat = nextFreeSeat(route, rand_r(&worker->seed) % route->capacity + 1);
+        if(seat == 0) seat = nextFreeSeat(route, 1);
+        releaseStore();
+        
+        if(seat == 0) {
+            worker->misses[LOAD_BOOK]++;
+            return 1;
+        }
+        
+        int bookingIndex = bookSeat(routeIndex, seat, name, phone, rand_r(&worker->seed) % 5 + 1);
+        if(bookingIndex == BOOK_SEAT_TAKEN) {
+            worker->conflicts[LOAD_BOOK]++;
+            continue;
+        }
+        if(bookingIndex < 0) return 0;
+        
+        // Another worker may already have edited or cancelled the booking, so
+        // the ticket is read under the route lock like any other reader.
+        char ticket[256] = "";
+        acquireStoreShared();
+        pthread_mutex_lock(routeLock(routeIndex));
+        if(seatBooking(routeIndex, seat) == bookingIndex) {
+            Payment *payment = &payments[bookings[bookingIndex].paymentID];
+            char transaction[TRANSACTION_ID_LENGTH];
+            snprintf(ticket, sizeof(ticket), "%s|%s|%d|%s|%s|%s|" MONEY_FORMAT, bookings[bookingIndex].name,
+                     bookings[bookingIndex].phone, seat, cityName(routes[routeIndex].sourceCity),
+                     cityName(routes[routeIndex].destinationCity),
+                     formatTransactionID(payment->transactionID, transaction), MONEY_ARGS(payment->totalPaid));
+        }
+        pthread_mutex_unlock(routeLock(routeIndex));
+        releaseStore();
+        return ticket[0] != 0;
+    }
+    return 1;
+}
+
+int loadCancel(LoadWorker *worker) {
+    int r = loadPickRoute(&worker->seed);
+    
+    acquireStoreShared();
+    int routeIndex = findRoute(loadSources[r], loadDestinations[r]);
+    int seat = routeIndex != -1 ? loadPickBookedSeat(routeIndex, &worker->seed) : 0;
+    releaseStore();
+    
+    if(seat == 0) {
+        worker->misses[LOAD_CANCEL]++;
+    } else if(cancelSeat(routeIndex, seat) == -1) {
+        worker->conflicts[LOAD_CANCEL]++;
+    }
+    return 1;
+}
+
+int loadEdit(LoadWorker *worker) {
+    int r = loadPickRoute(&worker->seed);
+    
+    acquireStoreShared();
+    int routeIndex = findRoute(loadSources[r], loadDestinations[r]);
+    int seat = routeIndex != -1 ? loadPickBookedSeat(routeIndex, &worker->seed) : 0;
+    releaseStore();
+    
+    char phone[PHONE_LENGTH];
+    snprintf(phone, sizeof(phone), "017%08d", rand_r(&worker->seed) % LOADGEN_PHONE_RANGE);
+    
+    if(seat == 0) {
+        worker->misses[LOAD_EDIT]++;
+    } else if(updateSeatDetails(routeIndex, seat, "Edited Passenger", phone) == -1) {
+        worker->conflicts[LOAD_EDIT]++;
+    }
+    return 1;
+}
+
+// Admin searches go through executeCommand so reply formatting is counted.
+int loadSearch(LoadWorker *worker, OutputBuffer *out) {
+    char command[64];
+    
+    if(rand_r(&worker->seed) % 2) {
+        snprintf(command, sizeof(command), "search|phone|017%08d", rand_r(&worker->seed) % LOADGEN_PHONE_RANGE);
+    } else {
+        snprintf(command, sizeof(command), "search|destination|%s", loadDestinations[loadPickRoute(&worker->seed)]);
+    }
+    
+    out->length = 0;
+    return executeCommand(command, out);
+}
+
+// With a target rate, each worker follows a fixed schedule and latency is
+// measured from when an operation was due rather than when it started, so
+// a stall shows up in the percentiles instead of silently lowering the load.
+void *loadWorkerMain(void *arg) {
+    LoadWorker *worker = arg;
+    OutputBuffer out = { NULL, 0, 0 };
+    struct timespec due, start, end;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    
+    while(1) {
+        if(worker->intervalNs > 0) {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+            start = due;
+            due.tv_nsec += worker->intervalNs;
+            due.tv_sec += due.tv_nsec / 1000000000;
+            due.tv_nsec %= 1000000000;
+        } else {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+        if(elapsedNanos(&worker->deadline, &start) > 0) break;
+        
+        int roll = rand_r(&worker->seed) % 100;
+        int operation;
+        if(roll < LOADGEN_BOOK_PERCENT) {
+            operation = LOAD_BOOK;
+            loadBook(worker);
+        } else if(roll < LOADGEN_BOOK_PERCENT + LOADGEN_CANCEL_PERCENT) {
+            operation = LOAD_CANCEL;
+            loadCancel(worker);
+        } else if(roll < LOADGEN_BOOK_PERCENT + LOADGEN_CANCEL_PERCENT + LOADGEN_EDIT_PERCENT) {
+            operation = LOAD_EDIT;
+            loadEdit(worker);
+        } else {
+            operation = LOAD_SEARCH;
+            loadSearch(worker, &out);
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        recordLatency(&worker->latency[operation], elapsedNanos(&start, &end));
+    }
+    
+    free(out.data);
+    return NULL;
+}
+
+// Drives the booking core with `threads` closed-loop workers for the given
+// number of seconds. rate is the total target in operations per second (0
+// runs flat out). The store starts empty in LOADGEN_DATA_PATH and
+// LOADGEN_JOURNAL_PATH, journaled as usual, and both files are removed
+// afterwards.
+int runLoadGenerator(int threads, int seconds, long rate, int routeTotal) {
+    if(threads < 1) threads = 1;
+    if(threads > LOADGEN_MAX_THREADS) threads = LOADGEN_MAX_THREADS;
+    if(seconds < 1) seconds = 1;
+    if(routeTotal < 1) routeTotal = 1;
+    
+    routesDataPath = LOADGEN_DATA_PATH;
+    journalPath = LOADGEN_JOURNAL_PATH;
+    unlink(LOADGEN_DATA_PATH);
+    unlink(LOADGEN_JOURNAL_PATH);
+    openJournal();
+    
+    loadSources = malloc(sizeof(*loadSources) * routeTotal);
+    loadDestinations = malloc(sizeof(*loadDestinations) * routeTotal);
+    LoadWorker *workers = calloc(threads, sizeof(LoadWorker));
+    if(loadSources == NULL || loadDestinations == NULL || workers == NULL) {
+        printf("Unable to allocate load generator!\n");
+        return 1;
+    }
+    
+    for(int r = 0; r < routeTotal; r++) {
+        int created;
+        snprintf(loadSources[r], SOURCE_LENGTH, "Hub%04d", r % 50);
+        snprintf(loadDestinations[r], DESTINATION_LENGTH, "City%05d", r);
+        if(lookupOrCreateRoute(loadSources[r], loadDestinations[r], &created) == -1) {
+            printf("Unable to create load routes!\n");
+            return 1;
+        }
+    }
+    loadRoutes = routeTotal;
+    
+    char rateText[32];
+    if(rate > 0) {
+        snprintf(rateText, sizeof(rateText), "%ld ops/s", rate);
+    } else {
+        strcpy(rateText, "unlimited");
+    }
+    printf("Load: %d thread(s), %d s, rate %s, %d routes, mix %d/%d/%d/%d book/cancel/edit/search\n",
+           threads, seconds, rateText, routeTotal, LOADGEN_BOOK_PERCENT,
+           LOADGEN_CANCEL_PERCENT, LOADGEN_EDIT_PERCENT,
+           100 - LOADGEN_BOOK_PERCENT - LOADGEN_CANCEL_PERCENT - LOADGEN_EDIT_PERCENT);
+    fflush(stdout);
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = 0;
+    for(int i = 0; i < threads; i++) {
+        workers[i].seed = (unsigned int)time(NULL) ^ (unsigned int)(i * 2654435761u);
+        workers[i].intervalNs = rate > 0 ? (long)(1e9 * threads / rate) : 0;
+        workers[i].deadline = start;
+        workers[i].deadline.tv_sec += seconds;
+        if(pthread_create(&workers[i].thread, NULL, loadWorkerMain, &workers[i]) != 0) break;
+        started++;
+    }
+    for(int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = elapsedNanos(&start, &end) / 1e9;
+    
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s %8s %10s\n", "op", "count", "ops/s", "p50 us",
+           "p99 us", "p99.9 us", "max us", "conflicts", "confl%", "misses");
+    
+    LatencyHistogram *all = calloc(1, sizeof(LatencyHistogram));
+    LatencyHistogram *merged = calloc(1, sizeof(LatencyHistogram));
+    if(all == NULL || merged == NULL) return 1;
+    
+    for(int op = 0; op < LOAD_OP_COUNT; op++) {
+        uint64_t conflicts = 0;
+        uint64_t misses = 0;
+        memset(merged, 0, sizeof(LatencyHistogram));
+        for(int i = 0; i < started; i++) {
+            mergeLatency(merged, &workers[i].latency[op]);
+            conflicts += workers[i].conflicts[op];
+            misses += workers[i].misses[op];
+        }
+        mergeLatency(all, merged);
+        
+        printf("%-8s %10llu %10.0f %10.1f %10.1f %10.1f %10.1f %10llu %7.2f%% %10llu\n", loadOperationNames[op],
+               (unsigned long long)merged->total, merged->total / elapsed,
+               latencyPercentile(merged, 50) / 1e3, latencyPercentile(merged, 99) / 1e3,
+               latencyPercentile(merged, 99.9) / 1e3, merged->maxNs / 1e3, (unsigned long long)conflicts,
+               merged->total > 0 ? 100.0 * conflicts / merged->total : 0.0, (unsigned long long)misses);
+    }
+    printf("%-8s %10llu %10.0f %10.1f %10.1f %10.1f %10.1f\n", "all", (unsigned long long)all->total,
+           all->total / elapsed, latencyPercentile(all, 50) / 1e3, latencyPercentile(all, 99) / 1e3,
+           latencyPercentile(all, 99.9) / 1e3, all->maxNs / 1e3);
+    printf("Conflicts: the picked seat changed hands first. Misses: book found the route sold out,\n"
+           "cancel/edit found nothing booked on it.\n");
+    printf("Seats booked at end: %d across %d routes\n", bookedSeats, routeCount);
+    
+    free(all);
+    free(merged);
+    free(workers);
+    
+    checkpointJournal();
+    fclose(journalFile);
+    journalFile = NULL;
+    unlink(LOADGEN_DATA_PATH);
+    unlink(LOADGEN_JOURNAL_PATH);
+    return 0;
+}
+
+#ifndef NO_METRICS
+MetricTimer startMetricTimer(int metric) {
+    MetricTimer timer = { metric, 0, { 0, 0 } };
+    clock_gettime(CLOCK_MONOTONIC, &timer.start);
+    return timer;
+}
+
+// Runs when a METRIC_SCOPE goes out of scope. Counters only ever grow and are
+// updated with relaxed atomics, so a concurrent reader may see a shard a few
+// operations behind but never a torn value.
+void finishMetricTimer(MetricTimer *timer) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ns = elapsedNanos(&timer->start, &now);
+    
+    if(metricShard == -1) {
+        metricShard = __atomic_fetch_add(&nextMetricShard, 1, __ATOMIC_RELAXED) % METRIC_SHARDS;
+    }
+    MetricShard *shard = &metricShards[metricShard];
+    LatencyHistogram *histogram = &shard->latency[timer->metric];
+    
+    __atomic_add_fetch(&histogram->counts[latencyBucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->elapsedNs[timer->metric], ns, __ATOMIC_RELAXED);
+    if(timer->failed) {
+        __atomic_add_fetch(&shard->failures[timer->metric], 1, __ATOMIC_RELAXED);
+    }
+    
+    uint64_t seen = __atomic_load_n(&histogram->maxNs, __ATOMIC_RELAXED);
+    while(ns > seen) {
+        if(__atomic_compare_exchange_n(&histogram->maxNs, &seen, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    }
+}
+#endif
+
+// Sums every shard into a new MetricShard the caller frees. Totals are
+// recounted from the buckets so percentiles stay consistent with them.
+// Returns NULL when metrics are compiled out.
+MetricShard *collectMetrics() {
+#ifndef NO_METRICS
+    MetricShard *total = calloc(1, sizeof(MetricShard));
+    if(total == NULL) return NULL;
+    
+    for(int s = 0; s < METRIC_SHARDS; s++) {
+        for(int m = 0; m < METRIC_COUNT; m++) {
+            LatencyHistogram *from = &metricShards[s].latency[m];
+            LatencyHistogram *into = &total->latency[m];
+            
+            for(int b = 0; b < LATENCY_BUCKETS; b++) {
+                uint64_t count = __atomic_load_n(&from->counts[b], __ATOMIC_RELAXED);
+                into->counts[b] += count;
+                into->total += count;
+            }
+            uint64_t maxNs = __atomic_load_n(&from->maxNs, __ATOMIC_RELAXED);
+            if(maxNs > into->maxNs) into->maxNs = maxNs;
+            total->elapsedNs[m] += __atomic_load_n(&metricShards[s].elapsedNs[m], __ATOMIC_RELAXED);
+            total->failures[m] += __atomic_load_n(&metricShards[s].failures[m], __ATOMIC_RELAXED);
+        }
+    }
+    return total;
+#else
+    return NULL;
+#endif
+}
+
+void adminViewMetrics() {
+    MetricShard *total = collectMetrics();
+    if(total == NULL) {
+        printf("\nMetrics are not available in this build.\n");
+        return;
+    }
+    
+    printf("\n=== PERFORMANCE METRICS (microseconds) ===\n");
+    printf("%-19s %9s %7s %9s %9s %9s %9s %9s %9s\n", "Operation", "Count", "Failed",
+           "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for(int m = 0; m < METRIC_COUNT; m++) {
+        LatencyHistogram *latency = &total->latency[m];
+        printf("%-19s %9llu %7llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", metricNames[m],
+               (unsigned long long)latency->total, (unsigned long long)total->failures[m],
+               latency->total > 0 ? total->elapsedNs[m] / 1e3 / latency->total : 0.0,
+               latencyPercentile(latency, 50) / 1e3, latencyPercentile(latency, 90) / 1e3,
+               latencyPercentile(latency, 99) / 1e3, latencyPercentile(latency, 99.9) / 1e3,
+               latency->maxNs / 1e3);
+    }
+    free(total);
+    
+    if(writeMetricsFile(METRICS_DUMP_PATH)) {
+        printf("Full histograms written to %s\n", METRICS_DUMP_PATH);
+    }
+}
+
+// One object per operation; "buckets" lists [value_ns, count] pairs for every
+// non-empty histogram bucket, value being the bucket midpoint.
+void outputMetricsJson(OutputBuffer *out, const MetricShard *total) {
+    outputPrintf(out, "{\n  \"generated_at\": %lld,\n  \"unit\": \"ns\",\n  \"operations\": {\n",
+                 (long long)time(NULL));
+    for(int m = 0; m < METRIC_COUNT; m++) {
+        const LatencyHistogram *latency = &total->latency[m];
+        outputPrintf(out, "    \"%s\": {\"count\": %llu, \"failures\": %llu, \"total_ns\": %llu, "
+                     "\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"buckets\": [",
+                     metricNames[m], (unsigned long long)latency->total,
+                     (unsigned long long)total->failures[m], (unsigned long long)total->elapsedNs[m],
+                     (unsigned long long)latencyPercentile(latency, 50),
+                     (unsigned long long)latencyPercentile(latency, 90),
+                     (unsigned long long)latencyPercentile(latency, 99),
+                     (unsigned long long)latencyPercentile(latency, 99.9),
+                     (unsigned long long)latency->maxNs);
+        
+        const char *separator = "";
+        for(int b = 0; b < LATENCY_BUCKETS; b++) {
+            if(latency->counts[b] == 0) continue;
+            outputPrintf(out, "%s[%llu, %llu]", separator, (unsigned long long)latencyBucketValue(b),
+                         (unsigned long long)latency->counts[b]);
+            separator = ", ";
+        }
+        outputPrintf(out, "]}%s\n", m + 1 < METRIC_COUNT ? "," : "");
+    }
+    outputPrintf(out, "  }\n}\n");
+}
+
+// Writes the metrics dump through a temporary file so readers polling path
+// never see half of it. Returns 1 on success.
+int writeMetricsFile(const char path[]) {
+    MetricShard *total = collectMetrics();
+    if(total == NULL) return 0;
+    
+    OutputBuffer out = { NULL, 0, 0 };
+    outputMetricsJson(&out, total);
+    free(total);
+    
+    char tmpPath[PATH_LENGTH];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    
+    FILE *file = fopen(tmpPath, "w");
+    int ok = file != NULL && out.data != NULL && fwrite(out.data, 1, out.length, file) == out.length;
+    if(file != NULL) {
+        ok = fclose(file) == 0 && ok;
+    }
+    ok = ok && rename(tmpPath, path) == 0;
+    if(!ok) {
+        unlink(tmpPath);
+    }
+    free(out.data);
+    return ok;
+}
+
+// Emits METRIC|name|count|failures|mean|p50|p90|p99|p99.9|max (nanoseconds)
+// for each operation and returns the number of lines, or -1 when metrics are
+// compiled out.
+int outputMetrics(OutputBuffer *out) {
+    MetricShard *total = collectMetrics();
+    if(total == NULL) return -1;
+    
+    for(int m = 0; m < METRIC_COUNT; m++) {
+        LatencyHistogram *latency = &total->latency[m];
+        outputPrintf(out, "METRIC|%s|%llu|%llu|%llu|%llu|%llu|%llu|%llu|%llu\n", metricNames[m],
+                     (unsigned long long)latency->total, (unsigned long long)total->failures[m],
+                     (unsigned long long)(latency->total > 0 ? total->elapsedNs[m] / latency->total : 0),
+                     (unsigned long long)latencyPercentile(latency, 50),
+                     (unsigned long long)latencyPercentile(latency, 90),
+                     (unsigned long long)latencyPercentile(latency, 99),
+                     (unsigned long long)latencyPercentile(latency, 99.9),
+                     (unsigned long long)latency->maxNs);
+    }
+    free(total);
+    return METRIC_COUNT;
+}
+
+int parseReportFormat(const char text[]) {
+    if(strcasecmp(text, "csv") == 0) return REPORT_CSV;
+    if(strcasecmp(text, "json") == 0) return REPORT_JSON;
+    if(strcasecmp(text, "columnar") == 0 || strcasecmp(text, "binary") == 0) return REPORT_COLUMNAR;
+    return -1;
+}
+
+// Local midnight, days after the YYYY-MM-DD date in text. Returns 0 if text
+// is not a date.
+int parseReportDate(const char text[], int days, int64_t *seconds) {
+    int year, month, day;
+    char extra;
+    if(sscanf(text, "%d-%d-%d%c", &year, &month, &day, &extra) != 3 ||
+       month < 1 || month > 12 || day < 1 || day > 31) {
+        return 0;
+    }
+    
+    struct tm date;
+    memset(&date, 0, sizeof(date));
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day + days;
+    date.tm_isdst = -1;
+    time_t midnight = mktime(&date);
+    if(midnight == (time_t)-1) return 0;
+    
+    *seconds = midnight;
+    return 1;
+}
+
+// Blank or "-" leaves a field unfiltered; dates are YYYY-MM-DD and both ends
+// are included. Returns NULL, or what was wrong.
+const char *parseReportFilter(const char source[], const char destination[], const char from[], const char to[],
+                              ReportFilter *filter) {
+    filter->sourceCity = filter->destinationCity = -1;
+    filter->from = filter->to = -1;
+    
+    if(source[0] != 0 && strcmp(source, "-") != 0 && (filter->sourceCity = findCity(source)) == -1) {
+        return "unknown source";
+    }
+    if(destination[0] != 0 && strcmp(destination, "-") != 0 &&
+       (filter->destinationCity = findCity(destination)) == -1) {
+        return "unknown destination";
+    }
+    if(from[0] != 0 && strcmp(from, "-") != 0 && !parseReportDate(from, 0, &filter->from)) {
+        return "invalid from date";
+    }
+    if(to[0] != 0 && strcmp(to, "-") != 0 && !parseReportDate(to, 1, &filter->to)) {
+        return "invalid to date";
+    }
+    return NULL;
+}
+
+// A path of "-" streams to standard output; anything else goes to a
+// temporary file that closeReport renames into place, so readers never see
+// half a report.
+int openReport(ReportWriter *report, const char path[], int format, const ReportColumn columns[], int columnCount) {
+    memset(report, 0, sizeof(*report));
+    report->fd = -1;
+    report->format = format;
+    report->columns = columns;
+    report->columnCount = columnCount;
+    snprintf(report->path, sizeof(report->path), "%s", path);
+    
+    report->buffer = malloc(REPORT_BUFFER_BYTES);
+    report->failed = report->buffer == NULL;
+    for(int c = 0; format == REPORT_COLUMNAR && c < columnCount; c++) {
+        report->blocks[c] = malloc((size_t)columns[c].width * REPORT_BLOCK_ROWS);
+        if(report->blocks[c] == NULL) report->failed = 1;
+    }
+    
+    if(!report->failed && strcmp(path, "-") == 0) {
+        fflush(stdout);
+        report->fd = STDOUT_FILENO;
+    } else if(!report->failed) {
+        char tmpPath[PATH_LENGTH + 8];
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", report->path);
+        report->fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if(report->failed || report->fd == -1) {
+        closeReport(report);
+        return 0;
+    }
+    
+    if(format == REPORT_CSV) {
+        for(int c = 0; c < columnCount; c++) {
+            if(c > 0) reportAppend(report, ",", 1);
+            reportAppend(report, columns[c].name, strlen(columns[c].name));
+        }
+        reportAppend(report, "\n", 1);
+    } else if(format == REPORT_JSON) {
+        reportAppend(report, "[", 1);
+    } else {
+        ReportFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, REPORT_FILE_MAGIC, sizeof(header.magic));
+        header.version = REPORT_FILE_VERSION;
+        header.endianMark = DATA_FILE_ENDIAN_MARK;
+        header.columnCount = (uint32_t)columnCount;
+        reportAppend(report, &header, sizeof(header));
+        
+        for(int c = 0; c < columnCount; c++) {
+            ReportColumnRecord record;
+            memset(&record, 0, sizeof(record));
+            snprintf(record.name, sizeof(record.name), "%s", columns[c].name);
+            record.type = (uint32_t)columns[c].type;
+            record.width = (uint32_t)columns[c].width;
+            reportAppend(report, &record, sizeof(record));
+        }
+    }
+    return 1;
+}
+
+void reportFlush(ReportWriter *report) {
+    size_t done = 0;
+    while(done < report->length && !report->failed) {
+        ssize_t written = write(report->fd, report->buffer + done, report->length - done);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) {
+            report->failed = 1;
+        } else {
+            done += (size_t)written;
+        }
+    }
+    report->length = 0;
+}
+
+// Pieces are at most one block column, well under the buffer size.
+void reportAppend(ReportWriter *report, const void *data, size_t length) {
+    if(report->length + length > REPORT_BUFFER_BYTES) {
+        reportFlush(report);
+    }
+    memcpy(report->buffer + report->length, data, length);
+    report->length += length;
+}
+
+// Writes at most width characters of text as a JSON string, or as a CSV
+// field that is quoted only when it has to be.
+void reportText(ReportWriter *report, const char text[], int width) {
+    char field[REPORT_FIELD_LENGTH];
+    size_t length = 0;
+    int json = report->format == REPORT_JSON;
+    int quoted = json || strpbrk(text, ",\"\r\n") != NULL;
+    
+    if(quoted) field[length++] = '"';
+    for(int i = 0; i < width && text[i] != 0; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if(json && (c == '"' || c == '\\')) {
+            field[length++] = '\\';
+            field[length++] = c;
+        } else if(json && c < 0x20) {
+            length += snprintf(field + length, sizeof(field) - length, "\\u%04x", c);
+        } else if(c == '"') {
+            field[length++] = '"';
+            field[length++] = '"';
+        } else {
+            field[length++] = c;
+        }
+    }
+    if(quoted) field[length++] = '"';
+    reportAppend(report, field, length);
+}
+
+// Writes number in decimal with a point before its last decimals digits (2
+// turns minor units into MONEY_FORMAT) and returns the length. printf is the
+// slowest part of a text report, and these are nearly every field.
+int formatReportNumber(char field[], int64_t number, int decimals) {
+    char digits[24];
+    int count = 0;
+    uint64_t magnitude = number < 0 ? 0 - (uint64_t)number : (uint64_t)number;
+    
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude != 0 || count <= decimals);
+    
+    int length = 0;
+    if(number < 0) field[length++] = '-';
+    while(count > 0) {
+        if(count == decimals) field[length++] = '.';
+        field[length++] = digits[--count];
+    }
+    return length;
+}
+
+void reportValue(ReportWriter *report, const ReportColumn *column, const ReportValue *value) {
+    char field[REPORT_FIELD_LENGTH];
+    int length;
+    
+    switch(column->type) {
+        case REPORT_TEXT:
+            reportText(report, value->text, column->width);
+            return;
+        case REPORT_MONEY:
+            length = formatReportNumber(field, value->number, 2);
+            break;
+        case REPORT_CLOCK:
+            snprintf(field, sizeof(field), DEPARTURE_FORMAT, DEPARTURE_ARGS((int)value->number));
+            reportText(report, field, sizeof(field));
+            return;
+        case REPORT_TIMESTAMP:
+            // Bookings come in bursts, so the last conversion is often reused.
+            if(value->number != report->lastStamp) {
+                time_t stamp = (time_t)value->number;
+                struct tm local;
+                report->lastStamp = value->number;
+                report->lastStampText[0] = 0;
+                if(stamp > 0 && localtime_r(&stamp, &local) != NULL) {
+                    strftime(report->lastStampText, REPORT_TIMESTAMP_LENGTH, "%Y-%m-%d %H:%M:%S", &local);
+                }
+            }
+            reportText(report, report->lastStampText, REPORT_TIMESTAMP_LENGTH);
+            return;
+        default:
+            length = formatReportNumber(field, value->number, 0);
+    }
+    reportAppend(report, field, length);
+}
+
+void reportBlock(ReportWriter *report) {
+    uint32_t rows = (uint32_t)report->blockRows;
+    reportAppend(report, &rows, sizeof(rows));
+    for(int c = 0; c < report->columnCount; c++) {
+        reportAppend(report, report->blocks[c], (size_t)report->columns[c].width * rows);
+    }
+    report->blockRows = 0;
+}
+
+// Runs between batches while storeLock is not held. Writes out the pending
+// block if the next batchRows rows might not fit in it, and the buffer once
+// it is half full, so the rows gathered under the next hold of the lock
+// normally need no write().
+void reportDrain(ReportWriter *report, int batchRows) {
+    if(report->format == REPORT_COLUMNAR && report->blockRows > 0 &&
+       report->blockRows + batchRows > REPORT_BLOCK_ROWS) {
+        reportBlock(report);
+    }
+    if(report->length > REPORT_BUFFER_BYTES / 2) {
+        reportFlush(report);
+    }
+}
+
+// values has one entry per column; text columns use text, the rest number.
+void reportRow(ReportWriter *report, const ReportValue values[]) {
+    if(report->format == REPORT_COLUMNAR) {
+        for(int c = 0; c < report->columnCount; c++) {
+            const ReportColumn *column = &report->columns[c];
+            char *slot = report->blocks[c] + (size_t)report->blockRows * column->width;
+            if(column->type == REPORT_TEXT) {
+                size_t length = strnlen(values[c].text, column->width);
+                memcpy(slot, values[c].text, length);
+                memset(slot + length, 0, column->width - length);
+            } else {
+                memcpy(slot, &values[c].number, sizeof(int64_t));
+            }
+        }
+        if(++report->blockRows == REPORT_BLOCK_ROWS) {
+            reportBlock(report);
+        }
+    } else {
+        int json = report->format == REPORT_JSON;
+        if(json) reportAppend(report, report->rows > 0 ? ",\n{" : "\n{", report->rows > 0 ? 3 : 2);
+        for(int c = 0; c < report->columnCount; c++) {
+            if(json) {
+                reportAppend(report, c > 0 ? ",\"" : "\"", c > 0 ? 2 : 1);
+                reportAppend(report, report->columns[c].name, strlen(report->columns[c].name));
+                reportAppend(report, "\":", 2);
+            } else if(c > 0) {
+                reportAppend(report, ",", 1);
+            }
+            reportValue(report, &report->columns[c], &values[c]);
+        }
+        reportAppend(report, json ? "}" : "\n", 1);
+    }
+    report->rows++;
+}
+
+// Finishes the format, writes out what is still buffered and frees the
+// writer. Returns 1 if the whole report reached its file.
+int closeReport(ReportWriter *report) {
+    if(report->fd != -1 && !report->failed) {
+        if(report->format == REPORT_COLUMNAR) {
+            if(report->blockRows > 0) reportBlock(report);
+            reportBlock(report);
+        } else if(report->format == REPORT_JSON) {
+            reportAppend(report, report->rows > 0 ? "\n]\n" : "]\n", report->rows > 0 ? 3 : 2);
+        }
+        reportFlush(report);
+    }
+    
+    int ok = report->fd != -1 && !report->failed;
+    free(report->buffer);
+    for(int c = 0; c < report->columnCount; c++) {
+        free(report->blocks[c]);
+    }
+    
+    if(report->fd != -1 && report->fd != STDOUT_FILENO) {
+        char tmpPath[PATH_LENGTH + 8];
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", report->path);
+        ok = close(report->fd) == 0 && ok;
+        ok = ok && rename(tmpPath, report->path) == 0;
+        if(!ok) {
+            unlink(tmpPath);
+        }
+    }
+    return ok;
+}
+
+// Caller holds storeLock shared. The route filters are checked against the
+// dense route column before the booking record itself is read.
+void reportBooking(ReportWriter *report, int bookingIndex, const ReportFilter *filter) {
+    int routeIndex = bookingRoutes[bookingIndex];
+    if(routeIndex == -1) return;
+    
+    Route *route = &routes[routeIndex];
+    if((filter->sourceCity != -1 && route->sourceCity != filter->sourceCity) ||
+       (filter->destinationCity != -1 && route->destinationCity != filter->destinationCity)) {
+        return;
+    }
+    
+    Booking *booking = &bookings[bookingIndex];
+    if((filter->from != -1 && booking->bookedAt < filter->from) ||
+       (filter->to != -1 && booking->bookedAt >= filter->to)) {
+        return;
+    }
+    
+    Payment *payment = booking->paymentID != -1 ? &payments[booking->paymentID] : NULL;
+    char transaction[TRANSACTION_ID_LENGTH] = "";
+    if(payment != NULL) {
+        formatTransactionID(payment->transactionID, transaction);
+    }
+    
+    ReportValue values[] = {
+        { bookingIndex, NULL },
+        { routeIndex, NULL },
+        { 0, cityName(route->sourceCity) },
+        { 0, cityName(route->destinationCity) },
+        { route->departureMinute, NULL },
+        { booking->seatNo, NULL },
+        { 0, booking->name },
+        { 0, booking->phone },
+        { booking->paymentID, NULL },
+        { 0, payment != NULL ? paymentMethods[payment->method].name : "" },
+        { 0, transaction },
+        { payment != NULL ? payment->amount : 0, NULL },
+        { payment != NULL ? payment->fee : 0, NULL },
+        { payment != NULL ? payment->totalPaid : 0, NULL },
+        { booking->bookedAt, NULL }
+    };
+    reportRow(report, values);
+}
+
+void reportRoute(ReportWriter *report, int routeIndex) {
+    Route *route = &routes[routeIndex];
+    int booked = bookedSeatCount(route);
+    
+    ReportValue values[] = {
+        { routeIndex, NULL },
+        { 0, cityName(route->sourceCity) },
+        { 0, cityName(route->destinationCity) },
+        { route->departureMinute, NULL },
+        { route->durationMinutes, NULL },
+        { route->capacity, NULL },
+        { booked, NULL },
+        { route->capacity - booked, NULL }
+    };
+    reportRow(report, values);
+}
+
+// Streams a report to path and returns its row count, or -1 if it could not
+// be written. Bookings to one destination are found through the city's route
+// list and seat maps; any other booking report scans the occupancy column.
+// storeLock is taken for one batch of rows at a time and the file is written
+// between batches, so a long export or a slow reader never holds up writers;
+// each batch reflects the store as it was when that batch was read.
+long writeReport(const char path[], int kind, int format, const ReportFilter *filter) {
+    METRIC_SCOPE(METRIC_REPORT);
+    ReportWriter report;
+    int opened = kind == REPORT_ROUTES
+               ? openReport(&report, path, format, routeReportColumns,
+                            sizeof(routeReportColumns) / sizeof(routeReportColumns[0]))
+               : openReport(&report, path, format, bookingReportColumns,
+                            sizeof(bookingReportColumns) / sizeof(bookingReportColumns[0]));
+    if(!opened) {
+        METRIC_FAILED();
+        return -1;
+    }
+    
+    if(kind == REPORT_ROUTES) {
+        int more = 1;
+        for(int first = 0; more; first += BOOKING_SCAN_BATCH) {
+            acquireStoreShared();
+            for(int r = first; r < first + BOOKING_SCAN_BATCH && r < routeCount; r++) {
+                if(routes[r].isActive &&
+                   (filter->sourceCity == -1 || routes[r].sourceCity == filter->sourceCity) &&
+                   (filter->destinationCity == -1 || routes[r].destinationCity == filter->destinationCity)) {
+                    reportRoute(&report, r);
+                }
+            }
+            more = first + BOOKING_SCAN_BATCH < routeCount;
+            releaseStore();
+            reportDrain(&report, BOOKING_SCAN_BATCH);
+        }
+    } else if(filter->destinationCity != -1) {
+        // Routes are never removed from a city's list, so a position stays
+        // valid while the lock is released between routes.
+        int more = 1;
+        for(int r = 0; more; r++) {
+            acquireStoreShared();
+            City *city = &cities[filter->destinationCity];
+            more = r < city->routeListCount;
+            int routeIndex = more ? city->routeList[r] : -1;
+            for(int word = 0; more && word < SEAT_WORDS; word++) {
+                uint64_t booked = __atomic_load_n(&routes[routeIndex].seatMap[word], __ATOMIC_ACQUIRE);
+                while(booked != 0) {
+                    int bookingIndex = seatBooking(routeIndex, word * 64 + __builtin_ctzll(booked) + 1);
+                    booked &= booked - 1;
+                    if(bookingIndex != -1) {
+                        reportBooking(&report, bookingIndex, filter);
+                    }
+                }
+            }
+            releaseStore();
+            reportDrain(&report, MAX_SEATS_PER_ROUTE);
+        }
+    } else {
+        int live[BOOKING_SCAN_BATCH];
+        int cursor = 0;
+        int found;
+        do {
+            acquireStoreShared();
+            pthread_mutex_lock(&phoneIndexLock);
+            found = scanBookings(&cursor, live, BOOKING_SCAN_BATCH);
+            pthread_mutex_unlock(&phoneIndexLock);
+            for(int k = 0; k < found; k++) {
+                reportBooking(&report, live[k], filter);
+            }
+            releaseStore();
+            reportDrain(&report, BOOKING_SCAN_BATCH);
+        } while(found > 0);
+    }
+    
+    long rows = (long)report.rows;
+    if(!closeReport(&report)) {
+        METRIC_FAILED();
+        return -1;
+    }
+    return rows;
+}
+
+// ttbs --report bookings|routes csv|json|columnar path [source] [destination]
+// [from] [to], with "-" for any filter left open. Returns the exit status.
+int runReport(int argc, char *argv[]) {
+    int kind = argc > 2 && strcmp(argv[2], "routes") == 0 ? REPORT_ROUTES
+             : argc > 2 && strcmp(argv[2], "bookings") == 0 ? REPORT_BOOKINGS : -1;
+    int format = argc > 3 ? parseReportFormat(argv[3]) : -1;
+    if(kind == -1 || format == -1 || argc < 5) {
+        fprintf(stderr, "Usage: %s --report bookings|routes csv|json|columnar path "
+                        "[source] [destination] [from YYYY-MM-DD] [to YYYY-MM-DD]\n", argv[0]);
+        return 1;
+    }
+    
+    ReportFilter filter;
+    const char *problem = parseReportFilter(argc > 5 ? argv[5] : "-", argc > 6 ? argv[6] : "-",
+                                            argc > 7 ? argv[7] : "-", argc > 8 ? argv[8] : "-", &filter);
+    if(problem != NULL) {
+        fprintf(stderr, "Report filter: %s\n", problem);
+        return 1;
+    }
+    
+    long rows = writeReport(argv[4], kind, format, &filter);
+    if(rows < 0) {
+        fprintf(stderr, "Unable to write report to %s\n", argv[4]);
+        return 1;
+    }
+    fprintf(stderr, "Wrote %ld rows to %s\n", rows, argv[4]);
+    return 0;
+}
+
+#ifdef TTBS_BENCH
+#undef malloc
+#undef calloc
+#undef realloc
+
+void *countedMalloc(size_t size) {
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+void *countedCalloc(size_t count, size_t size) {
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return calloc(count, size);
+}
+
+void *countedRealloc(void *pointer, size_t size) {
+    __atomic_add_fetch(&allocationCount, 1, __ATOMIC_RELAXED);
+    return realloc(pointer, size);
+}
+#endif